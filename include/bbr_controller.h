@@ -0,0 +1,67 @@
+#ifndef __BBR_CONTROLLER__
+#define __BBR_CONTROLLER__
+
+#include "congestion_control.h"
+#include <deque>
+
+/** BBR phases:
+ *  - STARTUP: Double the sending rate every round until bandwidth plateaus.
+ *  - DRAIN: Empty the queue built up during startup.
+ *  - PROBE_BW: Cruise at the estimated bandwidth, periodically probing up.
+ *  - PROBE_RTT: Briefly shrink the window to re-measure the minimum RTT.
+ */
+enum BbrPhase { BBR_STARTUP, BBR_DRAIN, BBR_PROBE_BW, BBR_PROBE_RTT };
+
+/**
+ * @brief Model-based congestion controller in the style of BBR (v1).
+ *
+ * Estimates the bottleneck bandwidth (windowed max of ACK delivery rates) and
+ * the minimum RTT, paces new messages at the estimated bandwidth and caps the
+ * window at a multiple of the bandwidth-delay product. Random loss does not
+ * shrink the window.
+ */
+class BbrController : public CongestionControl
+{
+  public:
+    BbrController();
+
+    void on_ack(const AckSample &sample) override;
+    void on_loss(time_p sent_at, time_p now) override;
+    void on_timeout(time_p now) override;
+    uint32_t window() const override;
+    double pacing_rate() const override;
+
+  private:
+    void update_bw(const AckSample &sample);
+    void update_min_rtt(const AckSample &sample);
+    void update_phase(const AckSample &sample);
+    double bdp() const;
+
+    BbrPhase phase{BbrPhase::BBR_STARTUP};
+    double pacing_gain;
+    double cwnd_gain;
+
+    /* Bottleneck bandwidth [messages/s]: max delivery rate per round. */
+    std::deque<std::pair<uint64_t, double>> bw_samples;
+    double btl_bw{0.0};
+    uint64_t round{0};
+
+    /* Minimum RTT [us] and when it was last lowered or refreshed. */
+    int64_t min_rtt_us{-1};
+    time_p min_rtt_at;
+
+    /* Startup exit: bandwidth didn't grow by 25 % for 3 rounds. */
+    double full_bw{0.0};
+    int full_bw_rounds{0};
+
+    /* PROBE_BW gain cycle position and when it was entered. */
+    int cycle_idx{0};
+    time_p cycle_at;
+
+    /* PROBE_RTT end. */
+    time_p probe_rtt_done;
+
+    uint32_t in_flight{0};
+};
+
+#endif /* __BBR_CONTROLLER__ */
@@ -7,21 +7,48 @@
  * @brief This is called ChecksumTransmitter, but it really only transmits
  * checksum confirmations from the receiver to the sender!
  *
+ * In stream mode the confirmation is a verdict ACK of the sender's checksum
+ * message rather than a message of its own, so the transfer ends one round
+ * trip sooner.
  */
 class ChecksumTransmitter : public Transmitter
 {
   public:
     ChecksumTransmitter(std::string &dest_ip, size_t out_msg_count,
-                        size_t in_msg_count, Queue<MainEvent> &main_queue,
-                        Queue<OutEvent> &out_queue, uint32_t min_ack_id,
-                        uint32_t min_msg_id);
+                        size_t in_msg_count, Session &session,
+                        OutQueue &out_queue, uint64_t min_ack_id,
+                        uint64_t min_msg_id);
 
-    ChecksumTransmitter(size_t in_msg_count, Queue<MainEvent> &main_queue,
-                        Queue<OutEvent> &out_queue, uint32_t min_ack_id,
-                        uint32_t min_msg_id);
+    ChecksumTransmitter(size_t in_msg_count, Session &session,
+                        OutQueue &out_queue, uint64_t min_ack_id,
+                        uint64_t min_msg_id);
 
     void send_checksum_confirmation_msg(bool match);
     void receive_checksum_msg();
+
+    /**
+     * @brief ACK the checksum message with the verdict: ACK_VERIFIED,
+     * ACK_MISMATCH or ACK_PARTIAL. Nothing ACKs an ACK, so linger_verdict()
+     * repeats it for every copy of the checksum message that still comes in,
+     * until the sender is quiet.
+     */
+    void send_checksum_verdict(uint64_t checksum_id, uint8_t verdict);
+    void linger_verdict(const std::vector<MainEvent> &evs);
+
+  private:
+    void push_verdict();
+
+    uint64_t checksum_id{0};
+    uint8_t verdict{ACK_MISMATCH};
+    time_p verdict_at;
 };
 
+/**
+ * @brief Decode a checksum confirmation sent by send_checksum_confirmation_msg.
+ *
+ * @param content
+ * @return bool If the receiver's checksum matched.
+ */
+bool parse_checksum_confirmation_msg(const std::vector<std::byte> &content);
+
 #endif /* __CHECKSUM_TRANSMITTER__ */
\ No newline at end of file
@@ -0,0 +1,78 @@
+#ifndef __CHUNK_CACHE__
+#define __CHUNK_CACHE__
+
+#include "sha256.h"
+#include "utils.h"
+#include <map>
+#include <memory>
+
+typedef std::shared_ptr<const std::vector<std::byte>> Chunk;
+
+/**
+ * @brief The file being sent, in chunk_len sized chunks, shared by the
+ * transmitters of all its receivers. A chunk is read from disk and hashed
+ * once, by whichever reader gets to it first, and kept until every reader
+ * has taken it. Readers keep their own references for resends, so a chunk
+ * is in memory once however many windows it is in.
+ *
+ * A reader that falls more than CHUNK_CACHE_LEN chunks behind the first one
+ * reads its chunks from disk again rather than holding the others up.
+ */
+class ChunkCache
+{
+  public:
+    ChunkCache(const std::string &filename, size_t chunk_len,
+               uint32_t readers);
+
+    ~ChunkCache();
+
+    /**
+     * @brief Chunk index (0 based) of the file, for reader. Every reader
+     * takes the chunks in order, once each.
+     */
+    Chunk take(uint32_t reader, uint64_t index);
+
+    /**
+     * @brief A chunk taken before, again, e.g. to repair it. Read from disk
+     * if it isn't kept any more, the readers stay where they are.
+     */
+    Chunk again(uint64_t index);
+
+    /**
+     * @brief The reader starts over, or is gone for good: its chunks aren't
+     * kept for it any more.
+     */
+    void rewind(uint32_t reader);
+    void leave(uint32_t reader);
+
+    size_t chunk_len() const;
+    uint64_t chunk_count() const;
+
+    /**
+     * @brief SHA of the whole file, once its last chunk was taken.
+     */
+    std::string sha();
+
+    /* Chunks read from disk so far, chunk_count() if nobody lagged. */
+    uint64_t disk_reads();
+
+  private:
+    Chunk read(uint64_t index);
+    void evict();
+
+    std::mutex mtx;
+    int fd{-1};
+    size_t len;
+    uint64_t f_size;
+    uint64_t count;
+
+    std::map<uint64_t, Chunk> chunks;
+    std::vector<uint64_t> next; /* Per reader, UINT64_MAX once it left. */
+
+    SHA256 hasher;
+    uint64_t hashed{0}; /* Chunks hashed, in order. */
+    std::string digest;
+    uint64_t reads{0};
+};
+
+#endif /* __CHUNK_CACHE__ */
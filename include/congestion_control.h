@@ -0,0 +1,79 @@
+#ifndef __CONGESTION_CONTROL__
+#define __CONGESTION_CONTROL__
+
+#include "utils.h"
+#include <memory>
+
+/** Available congestion controllers:
+ *  - CUBIC: loss-based window, backs off on every congestion event.
+ *  - BBR: model-based, paces at the estimated bottleneck bandwidth.
+ *  - LEDBAT: delay-based scavenger, yields as soon as queues build up.
+ */
+enum CongestionMode { CC_CUBIC, CC_BBR, CC_LEDBAT };
+
+/**
+ * @brief Information about a single acknowledged message, passed from the
+ * Transmitter to its congestion controller.
+ */
+typedef struct {
+    time_p now;          /* When the ACK was processed. */
+    time_p sent_at;      /* When the ACKed message was (last) sent. */
+    int64_t rtt_us;      /* RTT sample, -1 if ambiguous (retransmitted). */
+    uint32_t one_way_us; /* Receiver's ACK stamp minus our send stamp, off by
+                          * the clock offset; valid whenever rtt_us is. */
+    int64_t srtt_us;     /* Smoothed RTT of the session. */
+    uint32_t in_flight;  /* Unacknowledged messages after this ACK. */
+    uint64_t delivered;  /* Messages delivered since the ACKed one was sent. */
+    int64_t interval_us; /* Time over which `delivered` were delivered. */
+    bool round_start;    /* First ACK of a new round trip. */
+} AckSample;
+
+/**
+ * @brief Decides how many messages a Transmitter may have "in the air".
+ */
+class CongestionControl
+{
+  public:
+    virtual ~CongestionControl() = default;
+
+    /**
+     * @brief A message was acknowledged for the first time.
+     */
+    virtual void on_ack(const AckSample &sample) = 0;
+
+    /**
+     * @brief A message was detected as lost without waiting for the RTO
+     * (e.g. negative ACK).
+     *
+     * @param sent_at When the lost message was last sent. Losses of messages
+     * sent before the last window reduction don't reduce it again.
+     */
+    virtual void on_loss(time_p sent_at, time_p now) = 0;
+
+    /**
+     * @brief The retransmission timer expired.
+     */
+    virtual void on_timeout(time_p now) = 0;
+
+    /**
+     * @brief Congestion window in messages.
+     */
+    virtual uint32_t window() const = 0;
+
+    /**
+     * @brief Rate new messages should be paced at, in messages per second.
+     * 0 means no pacing, the window alone limits sending.
+     */
+    virtual double pacing_rate() const { return 0.0; }
+};
+
+std::unique_ptr<CongestionControl> make_congestion_control(CongestionMode mode);
+
+/**
+ * @brief Parse controller name ("cubic", "bbr", "ledbat").
+ *
+ * @return bool If the name is known.
+ */
+bool parse_congestion_mode(const std::string &name, CongestionMode &mode);
+
+#endif /* __CONGESTION_CONTROL__ */
@@ -0,0 +1,38 @@
+#ifndef __CUBIC_CONTROLLER__
+#define __CUBIC_CONTROLLER__
+
+#include "congestion_control.h"
+
+/**
+ * @brief Loss-based congestion controller: slow start, then CUBIC window
+ * growth (RFC 8312) with the Reno-friendly region as a lower bound.
+ */
+class CubicController : public CongestionControl
+{
+  public:
+    CubicController();
+
+    void on_ack(const AckSample &sample) override;
+    void on_loss(time_p sent_at, time_p now) override;
+    void on_timeout(time_p now) override;
+    uint32_t window() const override;
+
+  private:
+    void reduce(time_p now);
+
+    double cwnd;
+    double ssthresh;
+    double w_max{0.0};
+    double k{0.0};
+    double w_est{0.0};
+
+    /* Start of the current congestion avoidance epoch. */
+    time_p epoch_start;
+    bool in_epoch{false};
+
+    /* Losses of messages sent before this point belong to an already
+     * handled congestion event. */
+    time_p recovery_start;
+};
+
+#endif /* __CUBIC_CONTROLLER__ */
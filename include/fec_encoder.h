@@ -0,0 +1,50 @@
+#ifndef __FEC_ENCODER__
+#define __FEC_ENCODER__
+
+#include "utils.h"
+
+typedef struct {
+    uint64_t first;                 /* Message ID of the block's first packet. */
+    std::vector<std::byte> content; /* Block length, then the XOR parity. */
+} FecParity;
+
+/**
+ * @brief XOR parity over blocks of consecutive data packets, on the sending
+ * side. A block holds packets of one length, as many as block_len() of the
+ * current loss rate, and its parity can rebuild any single one of them. The
+ * parity goes out as an O_FEC frame under the block's first message ID.
+ */
+class FecEncoder
+{
+  public:
+    /**
+     * @brief Packets a parity should protect at a loss rate, 0 for no
+     * parity. Aims for about a quarter of a loss per block, so a block
+     * rarely loses more than the single packet its parity can rebuild.
+     */
+    static uint32_t block_len(double loss_rate);
+
+    /**
+     * @brief Add a data packet to the open block.
+     *
+     * @param k Block length to aim for, 0 to send no parity.
+     * @param parities Filled with the parities of the blocks it closed, the
+     * one before if the packet's length differs, and its own once full.
+     */
+    void add(uint64_t id, const std::vector<std::byte> &data, uint32_t k,
+             std::vector<FecParity> &parities);
+
+    /**
+     * @brief Close the open block before it is full, e.g. at the tail.
+     *
+     * @return If there was a block, its parity is in parity then.
+     */
+    bool close(FecParity &parity);
+
+  private:
+    std::vector<std::byte> parity;
+    uint64_t first{0};
+    uint32_t count{0};
+};
+
+#endif /* __FEC_ENCODER__ */
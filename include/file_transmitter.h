@@ -1,49 +1,167 @@
 #ifndef __FILE_TRANSMITTER__
 #define __FILE_TRANSMITTER__
 
+#include "chunk_cache.h"
+#include "fec_encoder.h"
+#include "session_params.h"
 #include "sha256.h"
 #include "transmitter.h"
+#include <fcntl.h>
+#include <map>
+#include <unistd.h>
 
 typedef struct {
-    std::vector<std::byte> data;
-    uint32_t msg_id;
-} PacketShelfItem;
+    time_p seen_at;   /* When a later packet revealed the gap. */
+    time_p nacked_at; /* When it was last NACKed. */
+    uint8_t nacks;    /* How many times it was NACKed. */
+} MissingPacket;
 
+/**
+ * @brief Reliable, ACKed file transfer. The sender's session starts with its
+ * header (message 0) and goes on with the data in the same flight, in the
+ * offered chunk length and window; the receiver's reply (its message 0) can
+ * only turn options off. Data (1 to f_pckt_n - 1) and the checksum message
+ * (f_pckt_n) follow, and the receiver's checksum verdict comes back on an
+ * ACK of the latter.
+ *
+ * With a deadline in the session, data is only partially reliable: the
+ * sender stops resending a packet that late and the receiver skips its gap,
+ * so a lost packet holds up the rest for a bounded time.
+ *
+ * A file that fits in the header goes inline instead: the header is the only
+ * message, and f_pckt_n is 0 so its ACK carries the verdict.
+ */
 class FileTransmitter : public Transmitter
 {
   public:
     FileTransmitter(std::string &dest_ip, size_t out_msg_count,
-                    size_t in_msg_count, Queue<MainEvent> &main_queue,
-                    Queue<OutEvent> &out_queue, uint32_t min_ack_id,
-                    uint32_t min_msg_id, uint32_t f_pckt_n);
+                    size_t in_msg_count, Session &session,
+                    OutQueue &out_queue, uint64_t min_ack_id,
+                    uint64_t min_msg_id, uint64_t f_pckt_n);
 
-    FileTransmitter(size_t in_msg_count, Queue<MainEvent> &main_queue,
-                    Queue<OutEvent> &out_queue, uint32_t min_ack_id,
-                    uint32_t min_msg_id, uint32_t f_pckt_n);
+    FileTransmitter(size_t in_msg_count, Session &session,
+                    OutQueue &out_queue, uint64_t min_ack_id,
+                    uint64_t min_msg_id, uint64_t f_pckt_n);
 
     ~FileTransmitter();
 
-    void start_stream_file(const std::string &filename, std::size_t chunk_size);
-    void continue_stream_file(std::size_t chunk_size, std::string &sha);
+    /**
+     * @brief Use the chunk length, window and options agreed on in the
+     * handshake. The sender also starts out within the receiver's window.
+     */
+    void apply_session(const SessionParams &params);
 
-    void prep_receive_file(const std::string &f_name);
+    /**
+     * @brief Send the header, data may follow right away.
+     */
+    void start_session(const SessionParams &offer);
+
+    /**
+     * @brief Data is taken from the cache as the given reader, the SHA in
+     * the checksum message too.
+     */
+    void start_stream_file(ChunkCache &cache, uint32_t reader);
+
+    void start_inline_file(SessionParams offer, const std::string &filename,
+                           const std::string &sha);
+    void continue_inline_file();
+    void continue_stream_file();
+
+    void prep_receive_file(const std::string &f_name, size_t f_size);
     void receive_stream_file(std::vector<MainEvent> evs);
     std::string receive_checksum_msg();
 
+    /**
+     * @brief SHA of the received file, hashed as its written prefix grew.
+     */
+    std::string file_sha();
+
+    /**
+     * @brief Data packets skipped over because they were later than the
+     * deadline. The file has zeros in their place.
+     */
+    uint64_t skipped_packets();
+
     bool did_receive_checksum_confirmation();
     bool receive_checksum_confirmation_msg();
 
+    /**
+     * @brief If the receiver's verdict was that the file is partial: it
+     * misses the data past the deadline, what it has isn't verified.
+     */
+    bool partial_verdict();
+
+    void set_ack(MainEvent ev) override;
+
     void close_write_file();
 
+  protected:
+    void check_completion() override;
+    bool keeps_content(uint64_t msg_id) const override;
+
   private:
+    /* Sending data packets, with XOR parity over blocks of them: */
+    void send_data(Chunk data);
+    void send_parity(const FecParity &parity);
+
+    /* Receiving data packets, rebuilding lost ones from parity: */
+    void store_packet(MainEvent &ev);
+    void receive_parity(MainEvent &ev);
+    void recover_block(uint64_t first);
+    void update_gaps(uint64_t msg_id);
+    void send_nacks();
+    void skip_late_packets();
+    void update_flow_window();
+    void advance_write_point(const MainEvent *latest);
+    void hash_packet(uint64_t id, const MainEvent *latest);
+
+    /* Session reply and checksum verdict, on the sending side: */
+    void apply_reply();
+    void probe_verdict();
+
     std::ifstream file;
-    std::ofstream file_o;
+    ChunkCache *cache{nullptr};
+    uint32_t cache_reader{0};
+    uint64_t next_chunk{0};
+    int file_fd{-1};
     bool sent_checksum{false};
-    uint32_t next_packet_id_to_write;
-    uint32_t f_pckt_n;
-    std::vector<PacketShelfItem> packet_shelf;
-    SHA256 sha;
-    std::unordered_map<uint32_t, uint32_t> recvd_fs_msgs;
+    uint64_t next_packet_id_to_write;
+    uint64_t f_pckt_n;
+    size_t file_len{0};
+
+    /* Agreed in the handshake: */
+    size_t chunk_len{DATA_LEN};
+    uint32_t flow_window{FLOW_WINDOW};
+    bool fec_enabled{true};
+    bool nack_enabled{true};
+    int64_t msg_deadline{0}; /* [us] 0: fully reliable. */
+
+    SHA256 sha;             /* Of the contiguous written prefix. */
+    ReceivedSet stored_ids; /* Data packets written, or skipped as late. */
+
+    FecEncoder fec; /* Parity of the block being sent. */
+
+    /* Recent received packets and pending parities, by (first) message ID: */
+    std::map<uint64_t, std::vector<std::byte>> fec_cache;
+    std::map<uint64_t, std::vector<std::byte>> fec_parities;
+
+    /* Packets missing below the highest received one, and the ID after it: */
+    std::map<uint64_t, MissingPacket> gaps;
+    uint64_t next_expected_id;
+    uint64_t skipped{0};
+
+    /* Checksum message, the verdict on it and probes for a lost verdict: */
+    std::vector<std::byte> checksum_content;
+    bool reply_applied{false};
+    bool got_verdict{false};
+    bool verdict_match{false};
+    bool verdict_partial{false};
+    uint32_t verdict_probes{0};
+    time_p probe_at;
+
+    /* Receive limit last sent in an explicit window update: */
+    uint64_t advertised_limit{0};
+    time_p advertised_at;
 };
 
-#endif /* __CHECKSUM_TRANSMITTER__ */
\ No newline at end of file
+#endif /* __FILE_TRANSMITTER__ */
\ No newline at end of file
@@ -0,0 +1,55 @@
+#ifndef __FOUNTAIN_TRANSMITTER__
+#define __FOUNTAIN_TRANSMITTER__
+
+#include "lt_code.h"
+#include "transmitter.h"
+#include <memory>
+
+/**
+ * @brief Rateless alternative to FileTransmitter: the sender streams LT code
+ * symbols of the file at FOUNTAIN_RATE until the receiver, which decodes once
+ * it has slightly more than K of them, confirms the checksum. Symbols are
+ * never ACKed or resent; only the SHA message and the confirmation are
+ * reliable.
+ */
+class FountainTransmitter : public Transmitter
+{
+  public:
+    FountainTransmitter(std::string &dest_ip, size_t out_msg_count,
+                        size_t in_msg_count, Session &session,
+                        OutQueue &out_queue, uint64_t min_ack_id,
+                        uint64_t min_msg_id, size_t f_size,
+                        size_t symbol_len);
+
+    FountainTransmitter(size_t in_msg_count, Session &session,
+                        OutQueue &out_queue, uint64_t min_ack_id,
+                        uint64_t min_msg_id, size_t f_size,
+                        size_t symbol_len);
+
+    void start_stream_symbols(const std::string &filename, std::string &sha);
+    void continue_stream_symbols();
+    bool receive_checksum_confirmation_msg();
+
+    void receive_symbols(std::vector<MainEvent> evs);
+    void write_file(const std::string &f_name);
+    std::string receive_checksum_msg();
+
+  protected:
+    void check_completion() override;
+
+  private:
+    void send_symbol();
+
+    std::ifstream file;
+    size_t f_size;
+    size_t symbol_len;
+    LtCode code;
+    std::unique_ptr<LtDecoder> decoder;
+
+    /* Sending: next symbol ID and fractional symbols owed to the rate. */
+    uint32_t next_symbol{0};
+    double credit{0.0};
+    time_p credit_at;
+};
+
+#endif /* __FOUNTAIN_TRANSMITTER__ */
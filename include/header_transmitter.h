@@ -1,22 +1,44 @@
 #ifndef __HEADER_TRANSMITTER__
 #define __HEADER_TRANSMITTER__
 
+#include "session_params.h"
 #include "transmitter.h"
 
+/**
+ * @brief Session handshake: the sender's header offers the SessionParams of
+ * the transfer, the receiver's reply (its message 0) carries the agreed ones.
+ *
+ * In stream mode the sender doesn't wait for the reply, its data follows the
+ * header right away. The reply then only turns options off, so it goes out
+ * unacknowledged and the receiver moves on to the data at once. An inline
+ * file gets no reply at all.
+ */
 class HeaderTransmitter : public Transmitter
 {
   public:
     HeaderTransmitter(std::string &dest_ip, size_t out_msg_count,
-                      size_t in_msg_count, Queue<MainEvent> &main_queue,
-                      Queue<OutEvent> &out_queue, uint32_t min_ack_id,
-                      uint32_t min_msg_id);
+                      size_t in_msg_count, Session &session,
+                      OutQueue &out_queue, uint64_t min_ack_id,
+                      uint64_t min_msg_id);
 
-    HeaderTransmitter(size_t in_msg_count, Queue<MainEvent> &main_queue,
-                      Queue<OutEvent> &out_queue, uint32_t min_ack_id,
-                      uint32_t min_msg_id);
+    HeaderTransmitter(size_t in_msg_count, Session &session,
+                      OutQueue &out_queue, uint64_t min_ack_id,
+                      uint64_t min_msg_id);
 
-    void send_header_msg(const std::string &f_name, const size_t &f_size);
-    void receive_header_msg(std::string &f_name, size_t &f_size);
+    void send_header_msg(const SessionParams &params);
+    SessionParams receive_header_msg();
+
+    /**
+     * @brief The receiver's answer to the offer, reliable in fountain and
+     * range mode only, left out for an inline file.
+     */
+    void send_header_reply(const SessionParams &params);
+
+  protected:
+    void check_completion() override;
+
+  private:
+    bool best_effort_reply{false};
 };
 
 #endif /* __HEADER_TRANSMITTER__ */
\ No newline at end of file
@@ -0,0 +1,60 @@
+#ifndef __LEDBAT_CONTROLLER__
+#define __LEDBAT_CONTROLLER__
+
+#include "congestion_control.h"
+#include <deque>
+
+/**
+ * @brief Delay-based scavenger congestion controller in the style of LEDBAT
+ * (RFC 6817).
+ *
+ * Measures the one-way delay of every unambiguous ACK from the receiver's
+ * timestamp, takes its minimum over the last minutes as the base delay and
+ * steers the window so the queuing delay above it stays at LEDBAT_TARGET.
+ * Any other flow that fills the bottleneck queue pushes the delay over the
+ * target, and the window shrinks long before that flow sees a loss.
+ */
+class LedbatController : public CongestionControl
+{
+  public:
+    LedbatController();
+
+    void on_ack(const AckSample &sample) override;
+    void on_loss(time_p sent_at, time_p now) override;
+    void on_timeout(time_p now) override;
+    uint32_t window() const override;
+
+  private:
+    void update_base_delay(uint32_t delay, time_p now);
+    int64_t queuing_delay() const;
+
+    double cwnd;
+    double ssthresh;
+
+    /* Grow by one message per ACK until the queue starts to build. */
+    bool slow_start{true};
+
+    /* Periodic slowdowns (LEDBAT++): the window drops to MIN_CWND for two
+     * RTTs, long enough for our own share of the queue to drain, so a flow
+     * that started on top of someone else's queue still finds the real
+     * base delay. Slow start then ramps back up to ssthresh. */
+    bool in_slowdown{false};
+    bool slowed_down{false};
+    time_p slowdown_at;
+    time_p slowdown_start;
+    time_p slowdown_end;
+
+    /* One-way delays include the unknown offset between the two clocks, so
+     * they are compared modulo 2^32 and only differences are used.
+     * Base: minimum per minute, oldest first. Current: the last few
+     * samples, their minimum filters out noise. */
+    std::deque<uint32_t> base_delays;
+    time_p base_rolled_at;
+    std::deque<uint32_t> current_delays;
+
+    /* Losses of messages sent before this point belong to an already
+     * handled congestion event. */
+    time_p recovery_start;
+};
+
+#endif /* __LEDBAT_CONTROLLER__ */
@@ -0,0 +1,81 @@
+#ifndef __LT_CODE__
+#define __LT_CODE__
+
+#include "utils.h"
+
+/**
+ * @brief Luby Transform (LT) fountain code over K source blocks.
+ *
+ * Every symbol is the XOR of a random set of source blocks, whose size is
+ * drawn from the robust soliton distribution. The set is derived from the
+ * symbol ID alone, so sender and receiver agree on it without sending it.
+ * A receiver can usually decode from any ~1.06 K symbols (large K).
+ */
+class LtCode
+{
+  public:
+    LtCode(uint32_t k);
+
+    /**
+     * @brief Source blocks the given symbol is the XOR of.
+     *
+     * @param symbol_id
+     * @param blocks Filled with distinct block indices.
+     */
+    void neighbours(uint32_t symbol_id, std::vector<uint32_t> &blocks) const;
+
+    uint32_t k;
+
+  private:
+    /* Cumulative robust soliton distribution, cdf[d - 1] = P(degree <= d). */
+    std::vector<double> cdf;
+};
+
+/**
+ * @brief Peeling (belief propagation) decoder for LtCode symbols.
+ */
+class LtDecoder
+{
+  public:
+    LtDecoder(uint32_t k, size_t symbol_len);
+
+    /**
+     * @brief Add a received symbol and decode as far as possible.
+     *
+     * @param symbol_id
+     * @param data Symbol payload, symbol_len bytes.
+     */
+    void add_symbol(uint32_t symbol_id, const std::vector<std::byte> &data);
+
+    /**
+     * @brief If all K source blocks are known.
+     */
+    bool done() const;
+
+    /**
+     * @brief Decoded source block, only valid once it is known.
+     */
+    const std::vector<std::byte> &block(uint32_t idx) const;
+
+    uint32_t decoded_count() const;
+
+  private:
+    typedef struct {
+        std::vector<uint32_t> blocks; /* Still unknown source blocks. */
+        std::vector<std::byte> data;  /* XOR of those blocks. */
+    } PendingSymbol;
+
+    void release(uint32_t idx, std::vector<std::byte> data);
+
+    LtCode code;
+    size_t symbol_len;
+    std::vector<std::vector<std::byte>> blocks;
+    std::vector<bool> known;
+    uint32_t known_count{0};
+
+    std::vector<PendingSymbol> pending;
+    /* Pending symbols each unknown block takes part in. */
+    std::vector<std::vector<uint32_t>> block_symbols;
+};
+
+#endif /* __LT_CODE__ */
@@ -0,0 +1,99 @@
+#ifndef __MULTICAST_TRANSMITTER__
+#define __MULTICAST_TRANSMITTER__
+
+#include "chunk_cache.h"
+#include "fec_encoder.h"
+#include "session_params.h"
+#include "transmitter.h"
+#include <map>
+#include <set>
+
+typedef struct {
+    std::string ip;
+    time_p heard_at;  /* Last reply, NACK or verdict. */
+    bool got_verdict; /* Checksum verdict in, */
+    bool match;       /* and what it said. */
+    bool given_up;    /* Went quiet, or can't take the offer. */
+} McastMember;
+
+/**
+ * @brief One-to-many file transfer: the sender's session goes to a multicast
+ * group, in the layout of a FileTransmitter session (header 0, data 1 to
+ * f_pckt_n - 1, checksum f_pckt_n), so every receiver runs its usual
+ * receiving side. Receivers answer under session IDs of their own: the
+ * header reply to join, NACKs of gaps, and the checksum verdict.
+ *
+ * Data goes once, at the session's rate cap, with XOR parity sized to the
+ * loss the NACKs report. Nothing is ACKed: NACKs of all receivers merge into
+ * one set of repairs, multicast ahead of new data, and a packet repaired
+ * less than an RTT ago isn't repaired again for NACKs crossing it.
+ */
+class MulticastTransmitter : public Transmitter
+{
+  public:
+    MulticastTransmitter(std::string &group_ip, Session &session,
+                         OutQueue &out_queue, uint64_t f_pckt_n);
+
+    /**
+     * @brief Announce the header, data follows once the receivers joined.
+     * Data is taken from the cache as its only reader, the SHA in the
+     * checksum message too.
+     *
+     * @param receivers Receivers to wait for, 0 for whoever joins within
+     * MCAST_JOIN_DELAY of the first announcement.
+     */
+    void start_multicast(const SessionParams &offer, ChunkCache &cache,
+                         uint32_t receivers);
+
+    /**
+     * @brief Throws if no receiver joined within MCAST_MEMBER_TIMEOUT of the
+     * first announcement.
+     */
+    void continue_multicast(const std::vector<MainEvent> &evs);
+
+    /**
+     * @brief Receivers by their session ID, once done: each has a verdict
+     * or was given up on.
+     */
+    const std::map<uint32_t, McastMember> &receivers() const;
+
+    /* Packets multicast again for NACKs. */
+    uint64_t repair_count{0};
+
+  protected:
+    void check_completion() override;
+
+  private:
+    void handle_event(const MainEvent &ev);
+    void announce();
+    void send_repairs();
+    void send_data();
+    void send_parity(const FecParity &parity);
+    void check_members();
+    McastMember &member(const MainEvent &ev);
+
+    ChunkCache *cache{nullptr};
+    uint64_t f_pckt_n;
+    size_t chunk_len{DATA_LEN};
+    bool fec_enabled{true};
+    std::vector<std::byte> header_content;
+    std::vector<std::byte> checksum_content;
+
+    /* Join phase: receivers waited for and when it began. */
+    uint32_t expected{0};
+    bool joining{true};
+    time_p started_at;
+    time_p announced_at;
+    time_p checksum_at;
+    bool sent_checksum{false};
+
+    std::map<uint32_t, McastMember> members;
+
+    /* NACKed packets, and when packets were last repaired: */
+    std::set<uint64_t> repairs;
+    std::map<uint64_t, time_p> repaired_at;
+
+    FecEncoder fec; /* Parity of the block being sent. */
+};
+
+#endif /* __MULTICAST_TRANSMITTER__ */
@@ -0,0 +1,89 @@
+#ifndef __OUT_QUEUE__
+#define __OUT_QUEUE__
+
+#include "token_bucket.h"
+#include "utils.h"
+#include <deque>
+
+/**
+ * @brief Queue of outgoing events, and the scheduler in front of the socket.
+ *
+ * Control events (L_CONTROL) go first, in order. Resends and data are
+ * queued per session and taken in deficit round robin: every turn a session
+ * may send its weight in DRR_QUANTUM bytes, its resends before its data.
+ * Sessions with a rate cap, and everything while the global cap is used up,
+ * wait for their token buckets. Control events count against the global
+ * cap, but never wait for it.
+ */
+class OutQueue
+{
+  public:
+    OutQueue();
+
+    /**
+     * @brief Queue an event in the lane of its type: ACKs and NACKs in
+     * L_CONTROL, everything else in L_DATA.
+     */
+    void push(const OutEvent &item);
+    void push(const OutEvent &item, OutLane lane);
+
+    /**
+     * @brief Wait for events and take up to max of them: control first,
+     * then resends and data by the schedule. Caps are ignored once stopping,
+     * so the queue drains.
+     */
+    std::vector<OutEvent> wait_nonempty(size_t max);
+
+    bool empty();
+
+    /**
+     * @brief Resends and data of a session still queued, the backlog it
+     * should keep small to not queue up behind its caps.
+     */
+    size_t queued(uint32_t session);
+
+    /**
+     * @brief Bandwidth share of a session: its weight against the others
+     * and its own cap [B/s], 0 for none. Unknown sessions have weight 1 and
+     * no cap.
+     */
+    void set_share(uint32_t session, uint32_t weight, double rate);
+    void forget_share(uint32_t session);
+
+    /**
+     * @brief Cap of everything sent [B/s], 0 for none.
+     */
+    void set_rate(double rate);
+
+    /**
+     * @brief Lowest cap a session is under [B/s], 0 for none.
+     */
+    double rate_cap(uint32_t session);
+
+    std::condition_variable cond;
+
+  private:
+    typedef struct {
+        std::queue<OutEvent> resends;
+        std::queue<OutEvent> data;
+        int64_t deficit; /* Bytes left of this turn. */
+    } Flow;
+
+    typedef struct {
+        uint32_t weight;
+        TokenBucket bucket;
+    } Share;
+
+    void take(size_t max, time_p now, std::vector<OutEvent> &list,
+              time_p &ready_at);
+
+    std::mutex mtx;
+    std::queue<OutEvent> control;
+    std::unordered_map<uint32_t, Flow> flows; /* Sessions with events. */
+    std::deque<uint32_t> active;               /* Their DRR order. */
+    std::unordered_map<uint32_t, Share> shares;
+    TokenBucket global{0.0};
+    size_t count{0};
+};
+
+#endif /* __OUT_QUEUE__ */
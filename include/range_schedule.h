@@ -0,0 +1,127 @@
+#ifndef __RANGE_SCHEDULE__
+#define __RANGE_SCHEDULE__
+
+#include "received_set.h"
+#include "session_params.h"
+#include <map>
+#include <set>
+
+typedef struct {
+    bool joined;          /* Has the file, chunks may be asked from it. */
+    bool left;            /* Gone for good. */
+    uint64_t outstanding; /* Chunks asked from it and not in yet. */
+    uint64_t delivered;   /* Chunks it was first to deliver. */
+    double rate;          /* [chunks/s] Moving average of its deliveries. */
+    uint64_t interval_delivered; /* Deliveries since interval_at. */
+    time_p interval_at;
+    time_p heard_at;          /* Its last delivery. */
+    time_p rack_requested_at; /* Latest requested chunk it delivered, */
+    uint64_t rack_index;      /* and its index. */
+} RangeSource;
+
+typedef struct {
+    uint32_t source;
+    time_p requested_at;
+    time_p behind_at; /* When a later chunk of the source overtook it. */
+} RangeRequest;
+
+/**
+ * @brief Which chunk of a pulled file is asked from which source, shared by
+ * the RangeTransmitters of all sources. Every source keeps outstanding about
+ * two pipeline delays worth of chunks at the rate it delivers, so faster
+ * ones get more of the file.
+ *
+ * Chunks a source was overtaken on, or that it sat on for RANGE_STALL_DELAY,
+ * go back for any source to take. A source that delivered nothing for that
+ * long is only probed with single new chunks until it does again, or until
+ * RANGE_QUIET_DELAY, when it is given up on.
+ */
+class RangeSchedule
+{
+  public:
+    RangeSchedule(const std::string &f_name, uint32_t sources);
+
+    ~RangeSchedule();
+
+    /**
+     * @brief A source answered the request for the file. The first one to
+     * have it sets the file up, the others need the same version of it.
+     *
+     * @return If chunks may be asked from it.
+     */
+    bool join(uint32_t source, const SessionParams &reply);
+
+    /**
+     * @brief The source is gone, what it owes goes back.
+     */
+    void leave(uint32_t source);
+
+    /**
+     * @brief The pull can't go on whatever the sources do, e.g. the file
+     * can't be written. It is done then, failure() says why.
+     */
+    void fail(const std::string &reason);
+    std::string failure();
+
+    /**
+     * @brief A chunk came in from the source, written unless it is in
+     * already.
+     */
+    void deliver(uint32_t source, uint64_t index,
+                 const std::vector<std::byte> &data);
+
+    /**
+     * @brief Take back the chunks the source lost or sat on too long.
+     *
+     * @return False if the source delivered nothing for RANGE_QUIET_DELAY,
+     * it left then.
+     */
+    bool reclaim(uint32_t source);
+
+    /**
+     * @brief Chunks to ask the source for now, as (first, count) ranges.
+     *
+     * @param srtt_us Round trip time to the source.
+     */
+    void assign(uint32_t source, int64_t srtt_us,
+                std::vector<std::pair<uint64_t, uint32_t>> &ranges);
+
+    /**
+     * @brief If all chunks are in, or no source is left to deliver them.
+     */
+    bool done();
+    bool complete();
+    void wait_done();
+
+    bool joined(uint32_t source);
+    uint64_t delivered(uint32_t source);
+    uint64_t chunk_count();
+    uint64_t file_size();
+    std::string sha();
+
+  private:
+    void drop(uint32_t source);
+    bool is_done();
+    bool stalled(const RangeSource &s, time_p now) const;
+    void update_rate(RangeSource &s, time_p now);
+
+    std::mutex mtx;
+    std::condition_variable cond;
+
+    std::string f_name;
+    int fd{-1};
+    bool set_up{false};
+    uint64_t f_size{0};
+    size_t chunk_len{0};
+    uint64_t count{0};
+    std::string file_sha;
+    std::string error; /* Set once the pull failed for good. */
+
+    std::vector<RangeSource> sources;
+    ReceivedSet received{0};
+    std::map<uint64_t, RangeRequest> requests; /* Outstanding, by chunk. */
+    std::set<uint64_t> returned;                /* Taken back, to ask again. */
+    uint64_t cursor{0};                         /* First chunk never asked. */
+};
+
+#endif /* __RANGE_SCHEDULE__ */
@@ -0,0 +1,62 @@
+#ifndef __RANGE_TRANSMITTER__
+#define __RANGE_TRANSMITTER__
+
+#include "range_schedule.h"
+#include "transmitter.h"
+#include <set>
+
+/**
+ * @brief Range pull of a file, after a T_RANGE handshake. The puller asks a
+ * source for ranges of chunks by their index, the source sends every chunk
+ * (index + 1 as its ID) from its offset in the file. Neither end ACKs: the
+ * puller asks again for what doesn't come, and what it keeps outstanding at
+ * a source is all that source sends, so the requests are the flow control.
+ *
+ * A puller pulls from one source, a RangeSchedule shares the file out among
+ * the pullers of all sources.
+ */
+class RangeTransmitter : public Transmitter
+{
+  public:
+    RangeTransmitter(std::string &dest_ip, Session &session,
+                     OutQueue &out_queue, RangeSchedule &schedule,
+                     uint32_t source);
+
+    RangeTransmitter(std::string &dest_ip, Session &session,
+                     OutQueue &out_queue);
+
+    ~RangeTransmitter();
+
+    /**
+     * @brief Pull until the schedule is done, then tell the source to stop.
+     */
+    void start_pulling();
+    void pull_ranges(const std::vector<MainEvent> &evs);
+
+    /**
+     * @brief Serve the ranges asked for, from the file described by the
+     * handshake reply, until the puller is done.
+     */
+    void start_serving(const std::string &filename,
+                       const SessionParams &params);
+    void serve_ranges(const std::vector<MainEvent> &evs);
+
+    /* Chunks sent, repeats included. */
+    uint64_t served_count{0};
+
+  private:
+    void request_ranges();
+    void send_end();
+    std::vector<std::byte> read_chunk(uint64_t index);
+
+    RangeSchedule *schedule{nullptr};
+    uint32_t source{0};
+
+    int file_fd{-1};
+    uint64_t file_len{0};
+    size_t chunk_len{DATA_LEN};
+    uint64_t chunk_count{0};
+    std::set<uint64_t> wanted; /* Asked for and not sent yet, in order. */
+};
+
+#endif /* __RANGE_TRANSMITTER__ */
@@ -0,0 +1,40 @@
+#ifndef __RECEIVED_SET__
+#define __RECEIVED_SET__
+
+#include "utils.h"
+#include <deque>
+
+/**
+ * @brief Set of received message IDs, as a bitmap over the IDs from a base
+ * ID on. One bit per message, grown as higher IDs arrive. Words that fill up
+ * at the front are dropped, so the bitmap only spans the IDs from the
+ * lowest missing one to the highest received one.
+ */
+class ReceivedSet
+{
+  public:
+    ReceivedSet(uint64_t base);
+
+    /**
+     * @brief Add a message ID.
+     *
+     * @return If it wasn't in the set yet. IDs below the base are never
+     * added.
+     */
+    bool insert(uint64_t id);
+
+    bool contains(uint64_t id) const;
+
+    /**
+     * @brief Number of IDs in the set.
+     */
+    size_t size() const;
+
+  private:
+    uint64_t first;
+    uint64_t base; /* First ID of words[0], all IDs before it are in. */
+    size_t count{0};
+    std::deque<uint64_t> words;
+};
+
+#endif /* __RECEIVED_SET__ */
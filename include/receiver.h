@@ -12,7 +12,11 @@
 class Receiver
 {
   public:
-    Receiver(int own_port);
+    /**
+     * @brief Listen on own_port, and in the multicast group too if one is
+     * given. Several receivers of a group may share the port on one host.
+     */
+    Receiver(int own_port, const std::string &group = "");
 
     ~Receiver();
 
@@ -0,0 +1,50 @@
+#ifndef __RTT_ESTIMATOR__
+#define __RTT_ESTIMATOR__
+
+#include "utils.h"
+
+/**
+ * @brief Smoothed RTT / RTT variance estimator and retransmission timeout
+ * calculation as described in RFC 6298.
+ *
+ * Only feed it samples from messages that were ACKed after being sent exactly
+ * once (Karn's algorithm), otherwise the ACK can't be matched to a send time.
+ */
+class RttEstimator
+{
+  public:
+    RttEstimator();
+
+    /**
+     * @brief Update SRTT, RTTVAR and the RTO from a new RTT measurement.
+     *
+     * @param rtt_us Measured round trip time in microseconds.
+     */
+    void add_sample(int64_t rtt_us);
+
+    /**
+     * @brief Double the RTO (up to MAX_RTO) after a retransmission timeout.
+     */
+    void backoff();
+
+    /**
+     * @brief Current retransmission timeout in microseconds.
+     */
+    int64_t rto() const;
+
+    /**
+     * @brief Smoothed RTT in microseconds. Before the first sample, this is
+     * the initial RTO.
+     */
+    int64_t srtt() const;
+
+    bool has_sample() const;
+
+  private:
+    int64_t srtt_us;
+    int64_t rttvar_us;
+    int64_t rto_us;
+    bool sampled{false};
+};
+
+#endif /* __RTT_ESTIMATOR__ */
@@ -0,0 +1,65 @@
+#ifndef __SEND_WINDOW__
+#define __SEND_WINDOW__
+
+#include "utils.h"
+#include <memory>
+
+/**
+ * @brief Send state of consecutively numbered messages, in a ring buffer
+ * indexed by message ID.
+ *
+ * Only the messages from the oldest unACKed one on are kept: the base of the
+ * window moves past ACKed messages, so memory is bounded by the window, not
+ * by everything sent. Payloads live apart from the per message metadata and
+ * are dropped as soon as the message is ACKed. They may be shared with
+ * other windows, the file chunks of a fan-out are.
+ */
+class SendWindow
+{
+  public:
+    SendWindow();
+
+    /**
+     * @brief Store a new message. IDs have to be consecutive.
+     *
+     * @return Its send state, valid until the next push().
+     */
+    SentMessage &push(uint64_t id, const std::vector<std::byte> &content);
+    SentMessage &push(uint64_t id,
+                      std::shared_ptr<const std::vector<std::byte>> content);
+
+    /**
+     * @brief Send state of a message that is not ACKed yet or is still
+     * inside the window, nullptr otherwise.
+     */
+    SentMessage *find(uint64_t id);
+
+    /**
+     * @brief Payload of an unACKed message, shared rather than copied.
+     */
+    std::shared_ptr<const std::vector<std::byte>> content(uint64_t id) const;
+
+    /**
+     * @brief Mark a message ACKed, drop its payload and slide the window.
+     */
+    void ack(uint64_t id);
+
+    /* Messages stored so far, and how many of them were ACKed: */
+    size_t sent() const;
+    size_t acked() const;
+
+  private:
+    void grow();
+    size_t slot(uint64_t id) const;
+
+    uint64_t base{0}; /* Oldest message still in the window. */
+    uint64_t end{0};  /* ID of the next message. */
+    size_t sent_count{0};
+    size_t acked_count{0};
+
+    /* Power of two sized rings, hot metadata apart from the payloads. */
+    std::vector<SentMessage> msgs;
+    std::vector<std::shared_ptr<const std::vector<std::byte>>> payloads;
+};
+
+#endif /* __SEND_WINDOW__ */
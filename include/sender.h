@@ -1,6 +1,7 @@
 #ifndef __SENDER__
 #define __SENDER__
 
+#include "utils.h"
 #include <arpa/inet.h>
 #include <cstring>
 #include <iostream>
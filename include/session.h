@@ -0,0 +1,49 @@
+#ifndef __SESSION__
+#define __SESSION__
+
+#include "utils.h"
+#include <atomic>
+
+/**
+ * @brief State of one transfer, shared by the thread running its
+ * transmitters and by in_thread and timeout_thread, which feed it. Every
+ * packet carries the session ID, so a receiver runs many sessions at once,
+ * one thread each.
+ */
+class Session
+{
+  public:
+    Session(uint32_t id);
+
+    const uint32_t id;
+
+    /* Events for the transmitters of this session: */
+    Queue<MainEvent> main_queue;
+
+    /* Next own message ID and copies of every ACK sent: */
+    volatile uint64_t next_id{0};
+    volatile uint32_t ack_count{1};
+
+    /* Tick period, following the RTO of the active transmitter, and the
+     * last tick: */
+    volatile uint32_t tick_delay{RESEND_DELAY};
+    time_p ticked_at;
+
+    /* First message ID the receiver has no room for, data may come along
+     * with the header: */
+    volatile uint64_t recv_limit{FLOW_WINDOW};
+
+    /* Highest message ID received from the peer, to restore wire IDs: */
+    volatile uint64_t peer_high_id{0};
+
+    /* Last time a packet of the session arrived, and if it was given up on
+     * for being quiet too long: */
+    std::atomic<time_p> heard_at;
+    volatile bool closed{false};
+
+    /* Data goes to a multicast group: nothing ACKs single packets, receivers
+     * only NACK and answer the header and checksum messages. */
+    volatile bool multicast{false};
+};
+
+#endif /* __SESSION__ */
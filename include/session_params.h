@@ -0,0 +1,91 @@
+#ifndef __SESSION_PARAMS__
+#define __SESSION_PARAMS__
+
+#include "utils.h"
+
+#define SESSION_VERSION 4   // Handshake format version, 4 added range pulls.
+#define SESSION_OPT_FEC 0x01    // Receiver rebuilds packets from XOR parity.
+#define SESSION_OPT_NACK 0x02   // Receiver NACKs gaps.
+#define SESSION_OPT_SHA256 0x04 // Whole file verified with SHA-256.
+
+/** How the file content is transferred after the header:
+ *  - STREAM: Reliable, ACKed data messages (FileTransmitter).
+ *  - FOUNTAIN: Rateless LT code symbols, no ACKs (FountainTransmitter).
+ *  - INLINE: Small files, in the header itself together with their SHA.
+ *  - RANGE: The other end pulls chunk ranges of a file this end has,
+ *    possibly from several sources at once (RangeTransmitter).
+ */
+enum TransferMode { T_STREAM, T_FOUNTAIN, T_INLINE, T_RANGE };
+
+/**
+ * @brief Parameters of one transfer. The sender offers them in the header,
+ * the receiver answers with what it agreed to.
+ */
+typedef struct {
+    uint8_t version;
+    TransferMode t_mode;
+    uint64_t f_size;
+    uint16_t chunk_len;  /* Data bytes per message / fountain symbol. */
+    uint32_t window;     /* Messages the receiver buffers past its write point. */
+    uint8_t ack_copies;  /* Copies of every ACK the receiver sends. */
+    uint8_t options;     /* SESSION_OPT_* flags. */
+    std::string f_name;
+    uint32_t deadline;   /* [ms] T_STREAM: data is dropped once this late,
+                            0 to deliver all of it. */
+    std::string sha;                /* T_INLINE, T_RANGE: SHA of the file, */
+    std::vector<std::byte> content; /* and the file itself. */
+} SessionParams;
+
+/**
+ * @brief What this build supports, for the given transfer.
+ */
+SessionParams local_session_params(TransferMode t_mode, uint64_t f_size,
+                                   const std::string &f_name);
+
+/**
+ * @brief The receiver's side of the negotiation: the smaller chunk length
+ * and window of the two ends, the larger number of ACK copies, and the
+ * options both support. Stream data in the offered chunk length is out
+ * before the reply, so a smaller chunk length agreed for a stream refuses
+ * the offer: the sender gives up on it as soon as the reply is in.
+ *
+ * @param offer From the sender's header.
+ * @param local local_session_params() of the receiver.
+ */
+SessionParams negotiate_session(const SessionParams &offer,
+                                const SessionParams &local);
+
+/**
+ * @brief If the file fits in the header of the offered session, so it can
+ * go as T_INLINE.
+ */
+bool fits_inline(const SessionParams &offer);
+
+/**
+ * @brief Binary, little-endian session encoding. Rules:
+ *
+ * - 4 bytes magic "UDPS", then the version byte.
+ *
+ * - Mode (1), file size (8), chunk length (2), window (4), ACK copies (1),
+ * options (1).
+ *
+ * - 16-bit file name length and the name, at most 256 characters.
+ *
+ * - T_STREAM only, from version 3 on: 32-bit data deadline in ms.
+ *
+ * - T_INLINE only: the 64 character SHA, then the file up to the end.
+ *
+ * - T_RANGE only: the 64 character SHA in the source's reply, none in the
+ * puller's request or when the source doesn't have the file.
+ *
+ * Later versions may only append fields, older receivers ignore them.
+ */
+std::vector<std::byte> encode_session(const SessionParams &params);
+
+/**
+ * @brief Decode encode_session() output, of this or a later version. Throws
+ * on garbage or a different magic.
+ */
+SessionParams decode_session(const std::vector<std::byte> &content);
+
+#endif /* __SESSION_PARAMS__ */
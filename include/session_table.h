@@ -0,0 +1,73 @@
+#ifndef __SESSION_TABLE__
+#define __SESSION_TABLE__
+
+#include "session.h"
+#include <deque>
+#include <memory>
+
+/**
+ * @brief Sessions by ID, shared by all threads. IDs of closed sessions are
+ * remembered for SESSION_IDLE_TIMEOUT, so their late headers don't open
+ * them again; by then their senders gave up too.
+ */
+class SessionTable
+{
+  public:
+    /**
+     * @brief Session with this ID, or joined to the multicast group session
+     * with this ID; nullptr if there is none.
+     */
+    std::shared_ptr<Session> find(uint32_t id);
+
+    /**
+     * @brief Session with this ID, opened if the ID is new.
+     *
+     * @param opened Set if this call opened it.
+     * @return nullptr if the session was closed already.
+     */
+    std::shared_ptr<Session> open(uint32_t id, bool &opened);
+
+    /**
+     * @brief Receiver's session of a multicast group session, opened if the
+     * group is new. It gets a random ID of its own, which everything sent
+     * back to the group's sender carries, so the sender tells its
+     * receivers apart.
+     *
+     * @param opened Set if this call opened it.
+     * @return nullptr if the session was closed already.
+     */
+    std::shared_ptr<Session> join(uint32_t group_id, bool &opened);
+
+    /**
+     * @brief The open multicast session of a sender, nullptr if there is
+     * none. Its receivers answer under IDs of their own.
+     */
+    std::shared_ptr<Session> find_multicast();
+
+    /**
+     * @brief Forget a session, and the group it joined, for good.
+     */
+    void close(uint32_t id);
+
+    /**
+     * @brief All open sessions.
+     */
+    std::vector<std::shared_ptr<Session>> all();
+
+    /**
+     * @brief Wake up everything waiting for events, on exit.
+     */
+    void notify_all();
+
+  private:
+    void remember_closed(uint32_t id, time_p now);
+    void forget_closed(time_p now);
+
+    std::mutex mtx;
+    std::unordered_map<uint32_t, std::shared_ptr<Session>> sessions;
+    std::unordered_map<uint32_t, uint32_t> groups; /* Group -> own ID. */
+    std::unordered_map<uint32_t, time_p> closed_ids; /* When closed. */
+    std::deque<uint32_t> closed_order;
+};
+
+#endif /* __SESSION_TABLE__ */
@@ -0,0 +1,62 @@
+#ifndef __TIMER_WHEEL__
+#define __TIMER_WHEEL__
+
+#include "utils.h"
+#include <list>
+
+/**
+ * @brief Hashed timer wheel of per-message deadlines.
+ *
+ * Deadlines are rounded up to MIN_TICK and hashed into a fixed ring of slots,
+ * so arming, cancelling and expiring a timer are O(1). Deadlines further out
+ * than one revolution share a slot with earlier ones and are skipped until
+ * their tick comes around.
+ */
+class TimerWheel
+{
+  public:
+    TimerWheel();
+
+    /**
+     * @brief Set the deadline of a message, replacing any earlier one.
+     *
+     * @param id Message ID.
+     * @param deadline Deadlines in the past expire on the next expire().
+     */
+    void arm(uint64_t id, time_p deadline);
+
+    /**
+     * @brief Drop the deadline of a message, if it has one.
+     */
+    void cancel(uint64_t id);
+
+    /**
+     * @brief Remove all timers whose deadline has passed.
+     *
+     * @param now
+     * @param expired Filled with the IDs of the expired messages.
+     */
+    void expire(time_p now, std::vector<uint64_t> &expired);
+
+    /**
+     * @brief IDs of all armed timers, in no particular order.
+     */
+    std::vector<uint64_t> armed() const;
+
+    size_t size() const;
+
+  private:
+    typedef struct {
+        uint64_t tick;
+        std::list<uint64_t>::iterator pos;
+    } Timer;
+
+    uint64_t elapsed_us(time_p t) const;
+
+    time_p start;
+    uint64_t cursor{0}; /* Last tick that was expired. */
+    std::vector<std::list<uint64_t>> slots;
+    std::unordered_map<uint64_t, Timer> timers;
+};
+
+#endif /* __TIMER_WHEEL__ */
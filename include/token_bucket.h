@@ -0,0 +1,42 @@
+#ifndef __TOKEN_BUCKET__
+#define __TOKEN_BUCKET__
+
+#include "utils.h"
+
+/**
+ * @brief Rate cap in bytes per second. Tokens refill at the rate, up to
+ * RATE_BURST worth of them, and a packet may go out while there is any
+ * token left. It can take the bucket below zero, the debt is paid back
+ * before the next one, so the rate holds on average.
+ */
+class TokenBucket
+{
+  public:
+    /**
+     * @param rate [B/s] 0 for no cap.
+     */
+    TokenBucket(double rate);
+
+    void set_rate(double rate);
+    double rate() const;
+    bool limited() const;
+
+    /**
+     * @brief If a packet may go out now, after refilling up to now.
+     */
+    bool has_room(time_p now);
+
+    void take(size_t bytes);
+
+    /**
+     * @brief When the bucket has room again.
+     */
+    time_p ready_at() const;
+
+  private:
+    double bytes_per_s;
+    double tokens{0.0};
+    time_p filled_at;
+};
+
+#endif /* __TOKEN_BUCKET__ */
@@ -1,6 +1,13 @@
 #ifndef __TRANSMITTER__
 #define __TRANSMITTER__
 
+#include "congestion_control.h"
+#include "out_queue.h"
+#include "received_set.h"
+#include "rtt_estimator.h"
+#include "send_window.h"
+#include "session.h"
+#include "timer_wheel.h"
 #include "utils.h"
 
 enum TransmitterMode { SEND, RECEIVE };
@@ -9,30 +16,41 @@ class Transmitter
 {
   public:
     Transmitter(std::string &dest_ip, size_t out_msg_count, size_t in_msg_count,
-                Queue<MainEvent> &main_queue, Queue<OutEvent> &out_queue,
-                uint32_t min_ack_id, uint32_t min_msg_id);
-    Transmitter(size_t in_msg_count, Queue<MainEvent> &main_queue,
-                Queue<OutEvent> &out_queue, uint32_t min_ack_id,
-                uint32_t min_msg_id);
+                Session &session, OutQueue &out_queue,
+                uint64_t min_ack_id, uint64_t min_msg_id);
+    Transmitter(size_t in_msg_count, Session &session,
+                OutQueue &out_queue, uint64_t min_ack_id,
+                uint64_t min_msg_id);
 
-    ~Transmitter();
+    virtual ~Transmitter();
 
     /* Base sending/receiving: */
 
     void send_msg(std::vector<std::byte> &data);
+    void send_msg(std::shared_ptr<const std::vector<std::byte>> data);
     void receive_msg(MainEvent ev);
     void resend_msg(SentMessage &msg);
-    void set_ack(MainEvent ev);
+    virtual void set_ack(MainEvent ev);
+    void receive_nack(MainEvent ev);
     void check_resends();
 
+    /**
+     * @brief If the congestion window, the receiver's window and pacing
+     * allow sending another new message right now, and the session's share
+     * of the link isn't backed up.
+     */
+    bool may_send();
+
     /* Main loop: */
     void run_main_body(std::function<void(std::vector<MainEvent>)> iter_func);
 
-    /* Queue REFERENCES and message hash tables: */
-    Queue<MainEvent> &main_queue;
-    Queue<OutEvent> &out_queue;
-    std::unordered_map<uint32_t, SentMessage> sent_msgs;
-    std::unordered_map<uint32_t, RecvdMessage> recvd_msgs;
+    /* Session and out queue REFERENCES, send window, received message IDs
+     * and the payloads kept from them: */
+    Session &session;
+    OutQueue &out_queue;
+    SendWindow sent_msgs;
+    ReceivedSet recvd_ids;
+    std::unordered_map<uint64_t, std::vector<std::byte>> recvd_msgs;
 
     /* Src/destination info: */
     std::string dest_ip;
@@ -43,16 +61,65 @@ class Transmitter
     size_t out_msg_count;
 
     /* Minimum ack/in message ids to work with: */
-    uint32_t min_ack_id;
-    uint32_t min_msg_id;
+    uint64_t min_ack_id;
+    uint64_t min_msg_id;
 
     TransmitterMode mode;
 
+    /* RTT estimate and RTO of this session: */
+    RttEstimator rtt;
+
+    /* Congestion window of this session: */
+    std::unique_ptr<CongestionControl> cc;
+
+    /* Sent messages that were not ACKed yet, and their resend deadlines: */
+    uint32_t in_flight{0};
+    TimerWheel timers;
+
+    /* First message ID the receiver has no room for, from its ACKs, and if
+     * one of them carried it yet: */
+    uint64_t peer_limit{UINT64_MAX};
+    bool heard_limit{false};
+
+    /* Moving average of the fraction of sent messages that were lost: */
+    double loss_rate{0.0};
+
+    /* Messages given up on, unACKed, once past their deadline: */
+    uint64_t expired_count{0};
+
   protected:
     bool done{false};
 
+    virtual void check_completion();
+
+    /**
+     * @brief If receive_msg() should keep the payload of a message in
+     * recvd_msgs. Subclasses that consume payloads themselves say no.
+     */
+    virtual bool keeps_content(uint64_t msg_id) const;
+
+    /* Delivery rate / pacing state: */
+    uint64_t delivered{0};
+    time_p delivered_at;
+    uint64_t next_round_delivered{0};
+    time_p next_send_at;
+
+    /* Loss detection: latest send time among ACKed messages (RACK), last
+     * time new data went out or got ACKed and if a tail probe is out. */
+    time_p rack_sent_at;
+    time_p progress_at;
+    bool probe_out{false};
+
+    void update_loss_rate(bool lost);
+
   private:
-    void check_completion();
+    double pacing_rate();
+    void detect_losses();
+    void send_tail_probe();
+    void expire_msg(SentMessage &msg);
+    void on_first_ack(const SentMessage &msg, bool recovered,
+                      uint32_t ack_stamp);
+    void update_tick_delay();
 };
 
 #endif /* __TRANSMITTER */
\ No newline at end of file
@@ -14,6 +14,7 @@
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <memory>
 #include <mutex>
 #include <queue>
 #include <signal.h>
@@ -43,32 +44,83 @@
 #define SENDER_TARGET_PORT 23000
 #endif
 
-#define DATA_LEN 1015       // bytes
+#define DATA_LEN 1007       // bytes, leaves room for the FEC block header
 #define PACKET_LEN 1024     // bytes
 #define CRC_LEN 4           // bytes
-#define RESEND_DELAY 300000 // [us] How long to wait before resending a packet.
+#define SESSION_ID_LEN 4    // bytes, in front of the frames of every packet
+#define FRAME_HEADER_LEN 7  // bytes, frame type, message ID and length
+#define RESEND_DELAY 300000 // [us] Initial RTO, before any RTT is measured.
+#define MIN_RTO 2000        // [us] Lower bound of the retransmission timeout.
+#define MAX_RTO 2000000     // [us] Upper bound of the (backed off) RTO.
+#define MIN_TICK 1000       // [us] Finest timeout check granularity.
 #define MAX_RETRIES 200     // Maximum number of times to send a packet.
-#define WINDOW_SIZE 4       // How many packets to have "in the air"
+#define INITIAL_CWND 10     // Packets "in the air" before any ACK arrives.
+#define MIN_CWND 2          // Congestion window never drops below this.
+#define MAX_CWND 8192       // Congestion window never grows above this.
+#define SOCK_BUF_LEN 4194304 // [B] Requested kernel socket buffer size.
+#define RECV_TIMEOUT 10000  // [us] Longest a receive blocks, bounds exit time.
+#define FEC_HEADER_LEN 2    // bytes, block length in front of the parity.
+#define FEC_MIN_K 4         // Fewest data packets protected by one parity.
+#define FEC_MAX_K 64        // Most data packets protected by one parity.
+#define FEC_MIN_LOSS 0.002  // Loss rate below which no parity is sent.
+#define FEC_CACHE_LEN 2048  // Received packets kept for FEC recovery.
+#define NACK_REORDER_DELAY 3000 // [us] How long a gap may last before NACK.
+#define FOUNTAIN_RATE 8000  // [kB/s] Fountain symbol rate, nothing to adapt to.
+#define ACK_OK 0xFF         // ACK content: message received intact.
+#define ACK_RECOVERED 0xFE  // ACK content: message rebuilt from FEC parity.
+#define ACK_VERIFIED 0xFD   // ACK content: checksum message, file matches it.
+#define ACK_MISMATCH 0xFC   // ACK content: checksum message, file doesn't match.
+#define ACK_PARTIAL 0xFB    // ACK content: checksum message, data past the
+                            // deadline is missing, the file can't match.
+#define ACK_BAD 0x00        // ACK content: message failed its CRC.
+#define ACK_LEN 9           // ACK content: status, receive limit, timestamp.
+#define ACK_RANGE_LEN 11    // ACK content with a count of consecutive IDs.
+#define FLOW_WINDOW 8192    // Messages a receiver buffers past its write point.
+#define FLOW_UPDATE_DELAY 20000 // [us] Least time between window updates.
+#define OUT_BURST 16        // Most events sent before lanes are re-checked.
+#define SESSION_IDLE_TIMEOUT 30000000 // [us] Receiver gives up a quiet session.
+#define DRR_QUANTUM PACKET_LEN // bytes a session of weight 1 sends per turn.
+#define RATE_BURST 20000    // [us] Burst a rate cap allows after idling.
+#define OUT_BACKLOG 32      // Events a session queues before it holds off.
+#define MCAST_SESSION_BIT 0x80000000 // Set in the session IDs of multicast.
+#define MCAST_RATE 8000     // [kB/s] Multicast data rate unless capped.
+#define MCAST_TTL 8         // Router hops multicast packets may take.
+#define PULL_ATTEMPTS 3     // Pulls of a file before a mismatch is final.
 
 /** Declaring controls for behaviour */
 
 extern volatile bool stop;
 extern volatile bool sending;
-extern volatile uint32_t next_id;
-extern volatile uint32_t ack_count;
 
 /** Possible types of main event types:
  *  - Received message
  *  - Acknowledged message
+ *  - Received FEC parity (not acknowledged)
+ *  - Received fountain code symbol (not acknowledged)
+ *  - Received list of missing messages (not acknowledged)
+ *  - Received request for a range of file chunks (not acknowledged)
+ *  - Received file chunk of a range pull (not acknowledged)
  *  - Timeout check
  */
-enum MainEventType { M_MSG, M_ACK, M_TIO };
+enum MainEventType { M_MSG, M_ACK, M_FEC, M_SYM, M_NACK, M_RANGE, M_CHUNK, M_TIO };
 
 /** Possible types of out event types:
  *  - Received message
  *  - Acknowledged message
+ *  - FEC parity over a block of messages
+ *  - Fountain code symbol
+ *  - List of missing messages the receiver asks for
+ *  - Range of file chunks a puller asks for
+ *  - File chunk, at its offset in the chunk layout
  */
-enum OutEventType { O_MSG, O_ACK };
+enum OutEventType { O_MSG, O_ACK, O_FEC, O_SYM, O_NACK, O_RANGE, O_CHUNK };
+
+/** Outbound lanes, in the order out_thread serves them:
+ *  - Control: ACKs, NACKs, range requests, window updates
+ *  - Retransmissions, ahead of new data of the same session
+ *  - New data, parity and symbols
+ */
+enum OutLane { L_CONTROL, L_RESEND, L_DATA, OUT_LANES };
 
 /**
  * @brief MainEvents are the only way to trigger main thread work.
@@ -83,9 +135,10 @@ enum OutEventType { O_MSG, O_ACK };
  */
 typedef struct {
     std::vector<std::byte> content; /* If rcvd, has content of msg. */
-    uint32_t msg_id;                /* Message ID of rcvd/ackd msg. */
+    uint64_t msg_id;                /* Message ID of rcvd/ackd msg. */
     std::string origin_ip;          /* Origin IP of incoming packet.*/
     MainEventType type;             /* MSG / ACK / TIO. */
+    uint32_t session{0};            /* Session ID the packet came with. */
 } MainEvent;
 
 /**
@@ -102,11 +155,19 @@ typedef struct {
  */
 typedef struct {
     std::vector<std::byte> content; /* If rcvd, has content of msg. */
-    uint32_t msg_id;                /* Message ID of rcvd/ackd msg. */
+    uint64_t msg_id;                /* Message ID of rcvd/ackd msg. */
     std::string dest_ip;            /* Origin IP of incoming packet.*/
     OutEventType type;              /* MSG / ACK. */
+    uint32_t session;               /* ID of the session it belongs to. */
+    /* Instead of content: a payload kept in a send window, not copied. */
+    std::shared_ptr<const std::vector<std::byte>> shared{};
 } OutEvent;
 
+/**
+ * @brief Content of an OutEvent, wherever it is kept.
+ */
+const std::vector<std::byte> &event_content(const OutEvent &ev);
+
 /**
  * @brief Generic queue suited for multi-threaded work.
  */
@@ -124,6 +185,25 @@ template <typename T> struct Queue {
         cond.notify_one();
     }
 
+    /**
+     * @brief Put items back in front of everything queued, in order.
+     */
+    void push_front(const std::vector<T> &items)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            std::queue<T> rest;
+            std::swap(rest, queue);
+            for (const T &item : items)
+                queue.push(item);
+            while (!rest.empty()) {
+                queue.push(rest.front());
+                rest.pop();
+            }
+        }
+        cond.notify_one();
+    }
+
     std::vector<T> wait_nonempty()
     {
         std::unique_lock<std::mutex> lock(mtx);
@@ -147,59 +227,122 @@ template <typename T> struct Queue {
         std::lock_guard<std::mutex> lock(mtx);
         return queue.empty();
     }
+
+    size_t size()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return queue.size();
+    }
 };
 
 typedef std::chrono::_V2::system_clock::time_point time_p;
 
+/* Per message send state, the payload is kept apart in the SendWindow. */
 typedef struct {
     bool ackd;
-    std::vector<std::byte> content;
-    uint32_t id;
+    uint64_t id;
     uint8_t retries;
     time_p sent_at;
+    uint64_t delivered;  /* Delivered message count when (re)sent. */
+    time_p delivered_at; /* Time of the last delivery when (re)sent. */
+    time_p expires_at;   /* Not resent past this, unless left unset. */
 } SentMessage;
 
+/**
+ * @brief Datagram ready to be sent, holding one or more frames.
+ */
 typedef struct {
-    std::vector<std::byte> content;
-    time_p received_at;
-} RecvdMessage;
+    std::vector<std::byte> bytes;
+    std::string dest_ip;
+} OutPacket;
 
 /**
- * @brief Message to packet encoding: Rules:
+ * @brief Frame encoding, a packet is one or more frames. Rules:
  *
- * - First byte indicates if it's data or ack.
+ * - First byte is the frame type (OutEventType).
  *
- * - Second, third byte is 16-bit ID.
+ * - Then the low 32 bits of the message ID, see expand_id.
  *
- * - Then DATA_LEN bytes of data.
+ * - Then the 16-bit content length and the content.
  *
- * - Then 4 bytes of CRC from all previous pieces.
+ * A packet starts with the 32-bit session ID and ends with 4 bytes of CRC
+ * over the ID and all of its frames. A full data frame makes a packet of
+ * `SESSION_ID_LEN + FRAME_HEADER_LEN + FEC_HEADER_LEN + DATA_LEN + CRC_LEN =
+ * PACKET_LEN` bytes.
  *
- * Total length of packet is `1 + 2 + DATA_LEN +4 =
- * DATA_LEN + 7 = PACKET_LEN.`
+ * @param packet Packet to append the frame to, started with the session ID.
+ * @param ev
+ */
+void append_frame(std::vector<std::byte> &packet, const OutEvent &ev);
+
+/**
+ * @brief Append the CRC over all frames, the packet is complete.
+ */
+void seal_packet(std::vector<std::byte> &packet);
+
+/**
+ * @brief Packet to frames decoding, per the rules from append_frame.
  *
  * @param packet
- * @param id
- * @param type
- * @param content
+ * @param origin_ip Set as the origin of every frame.
+ * @param session Set to the session ID of the packet.
+ * @param frames Filled with one event per frame, even if the CRC doesn't
+ * match, as long as the frames themselves are well formed. Frames of a
+ * type that isn't an OutEventType are left out.
+ *
+ * @return bool If CRC matches.
  */
-void msg2packet(std::vector<std::byte> &packet, uint32_t id, OutEventType type,
-                std::vector<std::byte> &data);
+bool packet2frames(const std::vector<std::byte> &packet,
+                   const std::string &origin_ip, uint32_t &session,
+                   std::vector<MainEvent> &frames);
 
 /**
- * @brief Packet to message decoding: Rules:
+ * @brief Bundle outgoing events into as few packets as possible.
  *
- * - Decode per rules from msg2packet.
+ * Events to the same destination and session share packets while they
+ * fit. An ACK for
+ * the ID after the ACK that ends a packet extends it into an ACK range.
+ * Repeated copies of one frame go to different packets, so a single lost
+ * packet doesn't take all of them.
  *
- * @param packet
- * @param id
- * @param type
- * @param content
+ * @param evs Events in the order they should go out.
+ * @param packets Filled with sealed packets, in order.
+ */
+void bundle_frames(const std::vector<OutEvent> &evs,
+                   std::vector<OutPacket> &packets);
+
+/**
+ * @brief ACK content: the status byte, then the receiver's current receive
+ * limit, the first message ID it has no buffer space for, then the
+ * wire_stamp() of when the ACK was made. An ACK range adds the 16-bit count
+ * of consecutive IDs it covers, and has the stamp of its first ACK.
  *
- * @return bool If CRC matches.
+ * @param status ACK_OK, ACK_RECOVERED, ACK_BAD or a checksum verdict.
+ * @param recv_limit Receive limit of the session.
+ */
+std::vector<std::byte> make_ack(uint8_t status, uint64_t recv_limit);
+
+/**
+ * @brief Low 32 bits of a time in microseconds, as timestamps go on the
+ * wire. Only differences between stamps of the same clock mean anything,
+ * taken modulo 2^32.
+ */
+uint32_t wire_stamp(time_p t);
+
+/**
+ * @brief Message IDs are 64-bit, but only their low 32 bits go on the wire.
+ * Restore the full ID as the one closest to what the peer is expected to
+ * send next, which is right as long as it is within 2^31 of it.
+ *
+ * @param wire_id ID as received.
+ * @param expected Next ID expected from the peer.
  */
-bool packet2msg(std::vector<std::byte> &packet, uint32_t &id,
-                MainEventType &type, std::vector<std::byte> &data);
+uint64_t expand_id(uint32_t wire_id, uint64_t expected);
+
+/**
+ * @brief If the IPv4 address is a multicast group (224.0.0.0/4).
+ */
+bool is_multicast_ip(const std::string &ip);
 
 /**
  * @brief Get the file size.
@@ -211,6 +354,12 @@ size_t get_file_size(const std::string &f_name);
 
 std::string extract_file_name(const std::string &file_path);
 
+/**
+ * @brief Where a file named by a peer goes: its name alone, in the working
+ * directory. Empty if that is empty or hidden (starts with '.').
+ */
+std::string local_file_name(const std::string &peer_name);
+
 std::string get_sha(const std::string &f_path);
 
 #endif /* __UTILS__ */
\ No newline at end of file
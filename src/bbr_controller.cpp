@@ -0,0 +1,154 @@
+#include "bbr_controller.h"
+#include <algorithm>
+
+#define BBR_HIGH_GAIN 2.885      // 2 / ln(2), doubles the rate every round.
+#define BBR_BW_ROUNDS 10         // Bandwidth max filter length [rounds].
+#define BBR_MIN_RTT_WIN 10000000 // [us] Min RTT expires after this.
+#define BBR_PROBE_RTT_LEN 200000 // [us] Time spent in PROBE_RTT.
+#define BBR_MIN_CWND 4           // Window during PROBE_RTT / lower bound.
+
+static const double probe_bw_gains[] = {1.25, 0.75, 1.0, 1.0,
+                                        1.0,  1.0,  1.0, 1.0};
+static const int probe_bw_cycle_len =
+    sizeof(probe_bw_gains) / sizeof(probe_bw_gains[0]);
+
+BbrController::BbrController()
+{
+    pacing_gain = BBR_HIGH_GAIN;
+    cwnd_gain = BBR_HIGH_GAIN;
+}
+
+void BbrController::on_ack(const AckSample &sample)
+{
+    in_flight = sample.in_flight;
+    if (sample.round_start)
+        ++round;
+
+    update_bw(sample);
+    update_min_rtt(sample);
+    update_phase(sample);
+}
+
+void BbrController::on_loss(time_p sent_at, time_p now)
+{
+    /* Loss is not taken as a congestion signal, the model only follows
+     * delivery rate and RTT. */
+    (void)sent_at;
+    (void)now;
+}
+
+void BbrController::on_timeout(time_p now)
+{
+    /* The RTO backoff already slows down retransmissions; the model is kept
+     * so the rate doesn't collapse on a single burst of random loss. */
+    (void)now;
+}
+
+uint32_t BbrController::window() const
+{
+    if (phase == BbrPhase::BBR_PROBE_RTT)
+        return BBR_MIN_CWND;
+
+    /* No estimate yet, go with the initial window. */
+    if (btl_bw <= 0.0 || min_rtt_us <= 0)
+        return INITIAL_CWND;
+
+    double cwnd = std::max<double>(cwnd_gain * bdp(), BBR_MIN_CWND);
+    return static_cast<uint32_t>(std::min<double>(cwnd, MAX_CWND));
+}
+
+double BbrController::pacing_rate() const
+{
+    return btl_bw > 0.0 ? pacing_gain * btl_bw : 0.0;
+}
+
+void BbrController::update_bw(const AckSample &sample)
+{
+    if (sample.interval_us <= 0 || sample.delivered == 0)
+        return;
+
+    double rate = sample.delivered * 1e6 / sample.interval_us;
+
+    if (bw_samples.empty() || bw_samples.back().first != round)
+        bw_samples.emplace_back(round, rate);
+    else
+        bw_samples.back().second = std::max(bw_samples.back().second, rate);
+
+    while (bw_samples.front().first + BBR_BW_ROUNDS < round)
+        bw_samples.pop_front();
+
+    btl_bw = 0.0;
+    for (const auto &s : bw_samples)
+        btl_bw = std::max(btl_bw, s.second);
+}
+
+void BbrController::update_min_rtt(const AckSample &sample)
+{
+    using namespace std::chrono;
+
+    if (sample.rtt_us <= 0)
+        return;
+
+    auto age = duration_cast<microseconds>(sample.now - min_rtt_at).count();
+    if (min_rtt_us < 0 || sample.rtt_us <= min_rtt_us) {
+        min_rtt_us = sample.rtt_us;
+        min_rtt_at = sample.now;
+    } else if (age > BBR_MIN_RTT_WIN &&
+               phase != BbrPhase::BBR_PROBE_RTT) {
+        /* Min RTT is stale, drain the queue to measure it again. */
+        phase = BbrPhase::BBR_PROBE_RTT;
+        pacing_gain = 1.0;
+        probe_rtt_done = sample.now + microseconds(BBR_PROBE_RTT_LEN);
+        min_rtt_us = sample.rtt_us;
+    }
+}
+
+void BbrController::update_phase(const AckSample &sample)
+{
+    using namespace std::chrono;
+
+    switch (phase) {
+    case BbrPhase::BBR_STARTUP:
+        if (!sample.round_start)
+            break;
+        if (btl_bw >= full_bw * 1.25) {
+            full_bw = btl_bw;
+            full_bw_rounds = 0;
+        } else if (++full_bw_rounds >= 3) {
+            phase = BbrPhase::BBR_DRAIN;
+            pacing_gain = 1.0 / BBR_HIGH_GAIN;
+            cwnd_gain = BBR_HIGH_GAIN;
+        }
+        break;
+    case BbrPhase::BBR_DRAIN:
+        if (in_flight <= bdp()) {
+            phase = BbrPhase::BBR_PROBE_BW;
+            cwnd_gain = 2.0;
+            cycle_idx = 2;
+            cycle_at = sample.now;
+            pacing_gain = probe_bw_gains[cycle_idx];
+        }
+        break;
+    case BbrPhase::BBR_PROBE_BW:
+        /* Each gain phase lasts roughly one min RTT. */
+        if (duration_cast<microseconds>(sample.now - cycle_at).count() >
+            min_rtt_us) {
+            cycle_idx = (cycle_idx + 1) % probe_bw_cycle_len;
+            cycle_at = sample.now;
+            pacing_gain = probe_bw_gains[cycle_idx];
+        }
+        break;
+    case BbrPhase::BBR_PROBE_RTT:
+        if (sample.now >= probe_rtt_done) {
+            min_rtt_at = sample.now;
+            bool filled = full_bw_rounds >= 3;
+            phase = filled ? BbrPhase::BBR_PROBE_BW : BbrPhase::BBR_STARTUP;
+            cwnd_gain = filled ? 2.0 : BBR_HIGH_GAIN;
+            pacing_gain = filled ? 1.0 : BBR_HIGH_GAIN;
+            cycle_at = sample.now;
+        }
+        break;
+    }
+}
+
+double BbrController::bdp() const { return btl_bw * min_rtt_us / 1e6; }
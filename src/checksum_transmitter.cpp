@@ -1,20 +1,28 @@
 #include "checksum_transmitter.h"
 
+#define CHKSUM_MSG_INV "Invalid checksum confirmation: insufficient data."
+#define CHKSUM_DATA_INV "Expected checksum confirmation, got something else."
+
+/* RTOs without another checksum message before the verdict is assumed in,
+ * and the fewest copies of the verdict sent each time. */
+#define VERDICT_LINGER_RTOS 2
+#define VERDICT_COPIES 3
+
 ChecksumTransmitter::ChecksumTransmitter(
     std::string &dest_ip, size_t out_msg_count, size_t in_msg_count,
-    Queue<MainEvent> &main_queue, Queue<OutEvent> &out_queue,
-    uint32_t min_ack_id, uint32_t min_msg_id)
-    : Transmitter{dest_ip,   out_msg_count, in_msg_count, main_queue,
+    Session &session, OutQueue &out_queue,
+    uint64_t min_ack_id, uint64_t min_msg_id)
+    : Transmitter{dest_ip,   out_msg_count, in_msg_count, session,
                   out_queue, min_ack_id,    min_msg_id}
 {
 }
 
 ChecksumTransmitter::ChecksumTransmitter(size_t in_msg_count,
-                                         Queue<MainEvent> &main_queue,
-                                         Queue<OutEvent> &out_queue,
-                                         uint32_t min_ack_id,
-                                         uint32_t min_msg_id)
-    : Transmitter{in_msg_count, main_queue, out_queue, min_ack_id, min_msg_id}
+                                         Session &session,
+                                         OutQueue &out_queue,
+                                         uint64_t min_ack_id,
+                                         uint64_t min_msg_id)
+    : Transmitter{in_msg_count, session, out_queue, min_ack_id, min_msg_id}
 {
 }
 
@@ -28,4 +36,54 @@ void ChecksumTransmitter::send_checksum_confirmation_msg(bool match)
         data.push_back(std::byte{static_cast<unsigned char>(c)});
     }
     send_msg(data);
-}
\ No newline at end of file
+}
+
+void ChecksumTransmitter::send_checksum_verdict(uint64_t checksum_id,
+                                                uint8_t verdict)
+{
+    this->checksum_id = checksum_id;
+    this->verdict = verdict;
+    push_verdict();
+}
+
+void ChecksumTransmitter::linger_verdict(const std::vector<MainEvent> &evs)
+{
+    using namespace std::chrono;
+
+    /* The sender resends or probes the checksum while it has no verdict. */
+    for (const MainEvent &ev : evs) {
+        if (ev.type == MainEventType::M_MSG && ev.msg_id == checksum_id) {
+            push_verdict();
+            break;
+        }
+    }
+
+    auto quiet = duration_cast<microseconds>(high_resolution_clock::now() -
+                                             verdict_at);
+    if (quiet.count() > VERDICT_LINGER_RTOS * rtt.rto())
+        this->done = true;
+}
+
+void ChecksumTransmitter::push_verdict()
+{
+    verdict_at = std::chrono::high_resolution_clock::now();
+    OutEvent e{make_ack(verdict, session.recv_limit),
+               checksum_id, dest_ip, OutEventType::O_ACK, session.id};
+    uint32_t copies = session.ack_count < VERDICT_COPIES ? VERDICT_COPIES
+                                                         : session.ack_count;
+    for (uint32_t i = 0; i < copies; ++i)
+        out_queue.push(e);
+}
+
+bool parse_checksum_confirmation_msg(const std::vector<std::byte> &content)
+{
+    if (content.size() < 16)
+        throw std::runtime_error(CHKSUM_MSG_INV);
+
+    /* Extract and validate the checksum confirmation text */
+    std::string h_text(reinterpret_cast<const char *>(content.data()) + 3, 6);
+    if (h_text != "CHKSUM")
+        throw std::runtime_error(CHKSUM_DATA_INV);
+
+    return (char)(content[12]) == '1';
+}
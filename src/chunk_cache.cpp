@@ -0,0 +1,120 @@
+#include "chunk_cache.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* Most chunks kept for readers behind the first one. */
+#define CHUNK_CACHE_LEN 16384
+
+ChunkCache::ChunkCache(const std::string &filename, size_t chunk_len,
+                       uint32_t readers)
+    : len{chunk_len}, next(readers, 0)
+{
+    fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Couldn't open file :( " + filename);
+
+    f_size = get_file_size(filename);
+    count = (f_size + len - 1) / len;
+    if (count == 0)
+        digest = hasher.getHash();
+}
+
+ChunkCache::~ChunkCache()
+{
+    if (fd >= 0)
+        close(fd);
+}
+
+Chunk ChunkCache::take(uint32_t reader, uint64_t index)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    next[reader] = index + 1;
+
+    Chunk chunk;
+    auto it = chunks.find(index);
+    if (it != chunks.end())
+        chunk = it->second;
+    else
+        chunk = read(index);
+
+    evict();
+    return chunk;
+}
+
+Chunk ChunkCache::again(uint64_t index)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = chunks.find(index);
+    if (it != chunks.end())
+        return it->second;
+
+    Chunk chunk = read(index);
+    evict();
+    return chunk;
+}
+
+void ChunkCache::rewind(uint32_t reader)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    next[reader] = 0;
+}
+
+void ChunkCache::leave(uint32_t reader)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    next[reader] = UINT64_MAX;
+    evict();
+}
+
+size_t ChunkCache::chunk_len() const { return len; }
+
+uint64_t ChunkCache::chunk_count() const { return count; }
+
+std::string ChunkCache::sha()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    if (digest.empty())
+        throw std::runtime_error("File not read to the end, no SHA yet.");
+
+    return digest;
+}
+
+uint64_t ChunkCache::disk_reads()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return reads;
+}
+
+Chunk ChunkCache::read(uint64_t index)
+{
+    off_t offset = static_cast<off_t>(index) * len;
+    size_t n = std::min<uint64_t>(len, f_size - offset);
+    auto data = std::make_shared<std::vector<std::byte>>(n);
+    if (n > 0 && pread(fd, data->data(), n, offset) != static_cast<ssize_t>(n))
+        throw std::runtime_error("Couldn't read file :( ");
+    ++reads;
+
+    /* Readers go in order, so the first read of a chunk is the next one to
+     * hash. Lagging readers read again what is hashed already. */
+    if (index == hashed) {
+        hasher.add(data->data(), n);
+        if (++hashed == count)
+            digest = hasher.getHash();
+    }
+
+    chunks[index] = data;
+    return data;
+}
+
+void ChunkCache::evict()
+{
+    /* Everyone is past these. */
+    uint64_t first = *std::min_element(next.begin(), next.end());
+    while (!chunks.empty() && chunks.begin()->first < first)
+        chunks.erase(chunks.begin());
+
+    /* Don't hold up memory for a reader far behind. */
+    while (chunks.size() > CHUNK_CACHE_LEN)
+        chunks.erase(chunks.begin());
+}
@@ -0,0 +1,31 @@
+#include "congestion_control.h"
+#include "bbr_controller.h"
+#include "cubic_controller.h"
+#include "ledbat_controller.h"
+
+std::unique_ptr<CongestionControl> make_congestion_control(CongestionMode mode)
+{
+    switch (mode) {
+    case CongestionMode::CC_BBR:
+        return std::make_unique<BbrController>();
+    case CongestionMode::CC_LEDBAT:
+        return std::make_unique<LedbatController>();
+    case CongestionMode::CC_CUBIC:
+    default:
+        return std::make_unique<CubicController>();
+    }
+}
+
+bool parse_congestion_mode(const std::string &name, CongestionMode &mode)
+{
+    if (name == "cubic")
+        mode = CongestionMode::CC_CUBIC;
+    else if (name == "bbr")
+        mode = CongestionMode::CC_BBR;
+    else if (name == "ledbat")
+        mode = CongestionMode::CC_LEDBAT;
+    else
+        return false;
+
+    return true;
+}
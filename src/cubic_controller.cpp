@@ -0,0 +1,85 @@
+#include "cubic_controller.h"
+#include <algorithm>
+#include <cmath>
+
+/* RFC 8312 constants; window in messages, time in seconds. */
+#define CUBIC_C 0.4
+#define CUBIC_BETA 0.7
+
+CubicController::CubicController()
+{
+    cwnd = INITIAL_CWND;
+    ssthresh = MAX_CWND;
+}
+
+void CubicController::on_ack(const AckSample &sample)
+{
+    using namespace std::chrono;
+
+    /* Slow start: one message per ACK, doubles the window every RTT. */
+    if (cwnd < ssthresh) {
+        cwnd = std::min<double>(cwnd + 1.0, MAX_CWND);
+        return;
+    }
+
+    if (!in_epoch) {
+        epoch_start = sample.now;
+        in_epoch = true;
+        if (cwnd < w_max) {
+            k = std::cbrt((w_max - cwnd) / CUBIC_C);
+        } else {
+            k = 0.0;
+            w_max = cwnd;
+        }
+        w_est = cwnd;
+    }
+
+    double rtt_s = sample.srtt_us / 1e6;
+    double t = duration_cast<microseconds>(sample.now - epoch_start).count() /
+               1e6;
+
+    /* Window CUBIC wants to reach one RTT from now. */
+    double target = CUBIC_C * std::pow(t + rtt_s - k, 3.0) + w_max;
+    target = std::clamp(target, cwnd, 1.5 * cwnd);
+
+    /* Reno-friendly estimate, grows by 3(1 - b)/(1 + b) messages per RTT. */
+    w_est += 3.0 * (1.0 - CUBIC_BETA) / (1.0 + CUBIC_BETA) / cwnd;
+
+    double next = cwnd + (target - cwnd) / cwnd;
+    cwnd = std::min<double>(std::max(next, w_est), MAX_CWND);
+}
+
+void CubicController::on_loss(time_p sent_at, time_p now)
+{
+    if (sent_at <= recovery_start)
+        return;
+
+    reduce(now);
+}
+
+void CubicController::on_timeout(time_p now)
+{
+    reduce(now);
+    /* Everything in the air is suspect, start over from slow start. */
+    cwnd = MIN_CWND;
+}
+
+uint32_t CubicController::window() const
+{
+    return static_cast<uint32_t>(std::max<double>(cwnd, MIN_CWND));
+}
+
+void CubicController::reduce(time_p now)
+{
+    /* Fast convergence: release bandwidth if the last maximum wasn't
+     * reached again. */
+    if (cwnd < w_max)
+        w_max = cwnd * (1.0 + CUBIC_BETA) / 2.0;
+    else
+        w_max = cwnd;
+
+    cwnd = std::max<double>(cwnd * CUBIC_BETA, MIN_CWND);
+    ssthresh = cwnd;
+    in_epoch = false;
+    recovery_start = now;
+}
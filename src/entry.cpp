@@ -1,11 +1,19 @@
 #include "checksum_transmitter.h"
+#include "chunk_cache.h"
 #include "file_transmitter.h"
+#include "fountain_transmitter.h"
 #include "header_transmitter.h"
+#include "multicast_transmitter.h"
+#include "range_transmitter.h"
 #include "receiver.h"
 #include "sender.h"
+#include "session_table.h"
 #include "transmitter.h"
 #include "utils.h"
+#include <algorithm>
 #include <math.h>
+#include <random>
+#include <sstream>
 
 #define UINT8(n) static_cast<uint8_t>(n)
 #define FLOAT(n) static_cast<float>(n)
@@ -14,24 +22,42 @@
 
 volatile bool stop = false;
 volatile bool sending = false;
-volatile uint32_t next_id = 0;
-volatile uint32_t ack_count = 1;
 
 /** Global parameters */
 
 std::string dest_ip;
+std::vector<std::string> dest_ips; /* More than one: fan-out to them all. */
+std::vector<uint32_t> dest_weights; /* Link share of each, against the rest. */
 std::string f_name;
+CongestionMode cc_mode = CongestionMode::CC_CUBIC;
+TransferMode transfer_mode = TransferMode::T_STREAM;
+uint32_t deadline_ms = 0; /* 0: all data is delivered, however late. */
+uint32_t rate_cap = 0; /* [kB/s] Of this transfer, 0 for none. */
+uint32_t max_rate = 0; /* [kB/s] Of all transfers, 0 for none. */
+bool multicast = false;       /* Sending to a multicast group. */
+uint32_t mcast_receivers = 0; /* Receivers to wait for, 0 for any. */
+std::string mcast_group;      /* Receiving: group joined, if any. */
+bool serving = false;         /* Listening: files here may be pulled. */
 
 /** Signal queues */
 
-Queue<MainEvent> main_queue;
-Queue<OutEvent> out_queue;
+OutQueue out_queue;
 std::condition_variable timeout_cv;
 
+/** Sessions, and the ones peers opened for the main thread to serve */
+
+SessionTable sessions;
+Queue<std::shared_ptr<Session>> opened_sessions;
+
 /** Helper declarations */
 
 std::string get_own_ip_addr();
 void process_args(int argc, char *argv[]);
+bool parse_number_option(const std::string &opt, const std::string &name,
+                         uint32_t &value);
+std::shared_ptr<Session> open_own_session(bool multicast);
+std::string part_file_name(uint32_t session_id);
+void serve_sessions();
 void terminate(int s);
 void setup_sigint_handler();
 
@@ -45,21 +71,23 @@ void out_thread_main()
 {
     Sender sender{sending ? SENDER_TARGET_PORT : RECEIVER_TARGET_PORT};
 
-    while (!stop) {
-        std::vector<OutEvent> evs = out_queue.wait_nonempty();
-        for (OutEvent ev : evs) {
-            std::vector<std::byte> packet;
-            msg2packet(packet, ev.msg_id, ev.type, ev.content);
-
-            sender.set_dest_ip(ev.dest_ip);
-            sender.send_packet(packet);
+    /* Drain what's queued before exiting, the last ACKs sent by a finished
+     * transfer are what lets the other side finish too. */
+    while (!stop || !out_queue.empty()) {
+        std::vector<OutEvent> evs = out_queue.wait_nonempty(OUT_BURST);
+        std::vector<OutPacket> packets;
+        bundle_frames(evs, packets);
+        for (OutPacket &packet : packets) {
+            sender.set_dest_ip(packet.dest_ip);
+            sender.send_packet(packet.bytes);
         }
     }
 }
 
 void in_thread_main()
 {
-    Receiver receiver{sending ? SENDER_LOCAL_PORT : RECEIVER_LOCAL_PORT};
+    Receiver receiver{sending ? SENDER_LOCAL_PORT : RECEIVER_LOCAL_PORT,
+                      mcast_group};
 
     while (!stop) {
         std::vector<std::byte> packet;
@@ -69,74 +97,583 @@ void in_thread_main()
         if (recvd_ip == "")
             continue;
 
-        MainEvent me = {.content{}, .msg_id{0}, .origin_ip{recvd_ip}, .type{}};
-        bool crc_match = packet2msg(packet, me.msg_id, me.type, me.content);
+        uint32_t session_id = 0;
+        std::vector<MainEvent> frames;
+        bool crc_match = packet2frames(packet, recvd_ip, session_id, frames);
+
+        /* A receiver opens a session for every new ID it can trust, or
+         * joins it if it is a group's, once its header is in: anything
+         * else of an unknown ID is a stray. The sender only knows its own,
+         * and the receivers of its group answer under IDs of their own. */
+        bool header = std::any_of(
+            frames.begin(), frames.end(), [](const MainEvent &me) {
+                return me.type == MainEventType::M_MSG && me.msg_id == 0;
+            });
+        bool opened = false;
+        std::shared_ptr<Session> session;
+        if (crc_match && !sending && header)
+            session = session_id & MCAST_SESSION_BIT
+                          ? sessions.join(session_id, opened)
+                          : sessions.open(session_id, opened);
+        else
+            session = sessions.find(session_id);
+        if (!session && crc_match && sending)
+            session = sessions.find_multicast();
+        if (!session)
+            continue;
+        if (opened)
+            opened_sessions.push(session);
+        if (crc_match)
+            session->heard_at = std::chrono::high_resolution_clock::now();
+
+        for (MainEvent &me : frames) {
+            /* Restore full IDs: our own near next_id, the peer's near the
+             * highest one it sent so far. */
+            if (me.type == MainEventType::M_ACK)
+                me.msg_id = expand_id(me.msg_id, session->next_id);
+            else if (me.type == MainEventType::M_MSG ||
+                     me.type == MainEventType::M_FEC ||
+                     me.type == MainEventType::M_CHUNK)
+                me.msg_id = expand_id(me.msg_id, session->peer_high_id);
+            if (crc_match &&
+                (me.type == MainEventType::M_MSG ||
+                 me.type == MainEventType::M_CHUNK) &&
+                me.msg_id > session->peer_high_id)
+                session->peer_high_id = me.msg_id;
+
+            OutEvent oe = {.content = make_ack(crc_match ? UINT8(ACK_OK)
+                                                         : UINT8(ACK_BAD),
+                                               session->recv_limit),
+                           .msg_id = me.msg_id,
+                           .dest_ip = recvd_ip,
+                           .type = OutEventType::O_ACK,
+                           .session = session->id};
+
+            /* If this is a message, send an ACK. Multicast data is only
+             * NACKed. */
+            if (me.type == MainEventType::M_MSG && !session->multicast) {
+                for (uint32_t i = 0; i < session->ack_count; ++i)
+                    out_queue.push(oe);
+            }
+
+            /* If CRC matches, pass upwards. An ACK range is passed on as
+             * one ACK per message. */
+            if (!crc_match)
+                continue;
+            if (me.type == MainEventType::M_ACK &&
+                me.content.size() == ACK_RANGE_LEN) {
+                uint16_t count = 0;
+                memcpy(&count, &me.content[ACK_LEN], sizeof(count));
+                me.content.resize(ACK_LEN);
+                for (uint16_t i = 0; i < count; ++i, ++me.msg_id)
+                    session->main_queue.push(me);
+            } else {
+                session->main_queue.push(me);
+            }
+        }
+    }
+}
 
-        OutEvent oe = {.content = std::vector<std::byte>{std::byte{
-                           crc_match ? UINT8(255) : UINT8(0)}},
-                       .msg_id = me.msg_id,
-                       .dest_ip = recvd_ip,
-                       .type = OutEventType::O_ACK};
+void timeout_thread_main()
+{
+    using namespace std::chrono;
 
-        /* If this is a message, send an ACK. */
-        if (me.type == MainEventType::M_MSG) {
-            for (uint32_t i = 0; i < ack_count; ++i)
-                out_queue.push(oe);
+    /* Every session ticks at its own tick_delay, which follows the RTO of its
+     * active transmitter. Sleep in slices at most, a long delay shouldn't
+     * hold up the exit or a new session. */
+    while (!stop) {
+        auto now = high_resolution_clock::now();
+        auto wake = now + microseconds(RECV_TIMEOUT);
+        for (auto &session : sessions.all()) {
+            MainEvent e{std::vector<std::byte>{}, 0, "", MainEventType::M_TIO};
+
+            /* A receiver gives up on senders that went quiet, the tick wakes
+             * the session up to notice. */
+            if (!sending && !session->closed &&
+                now - session->heard_at.load() >
+                    microseconds(SESSION_IDLE_TIMEOUT)) {
+                session->closed = true;
+                session->main_queue.push(e);
+                continue;
+            }
+
+            auto next =
+                session->ticked_at + microseconds(session->tick_delay);
+            if (next <= now) {
+                session->ticked_at = now;
+                session->main_queue.push(e);
+                next = now + microseconds(session->tick_delay);
+            }
+            wake = std::min(wake, next);
         }
+        std::this_thread::sleep_until(wake);
+    }
+}
 
-        /* If CRC matches, pass upwards. */
-        if (crc_match)
-            main_queue.push(me);
+/* Main sending and transmitting logic: */
+
+bool multicast_logic(Session &session)
+{
+    using namespace std::chrono;
+    size_t size = get_file_size(f_name);
+    SessionParams offer = local_session_params(TransferMode::T_STREAM, size,
+                                               extract_file_name(f_name));
+
+    /* Number of packets the file requires. +1 is for checksum. */
+    ChunkCache cache{f_name, offer.chunk_len, 1};
+    uint64_t f_pckt_n = cache.chunk_count() + 1;
+
+    MulticastTransmitter mcast_transm{dest_ip, session, out_queue, f_pckt_n};
+
+    auto start = high_resolution_clock::now();
+
+    mcast_transm.start_multicast(offer, cache, mcast_receivers);
+    mcast_transm.run_main_body([&mcast_transm](std::vector<MainEvent> evs) {
+        mcast_transm.continue_multicast(evs);
+    });
+
+    if (stop)
+        return true;
+
+    auto end = high_resolution_clock::now();
+    auto duration = duration_cast<microseconds>(end - start);
+    auto speed = size / FLOAT(duration.count()) * 1000.0f; // [kB / s]
+
+    /* Receivers that went quiet are left to their own retries, only a
+     * mismatch sends the file again. */
+    size_t verified = 0;
+    size_t mismatched = 0;
+    for (auto &[id, m] : mcast_transm.receivers()) {
+        if (m.got_verdict && m.match) {
+            ++verified;
+        } else if (m.got_verdict) {
+            ++mismatched;
+            std::cout << "File transfer to " << m.ip << " failed."
+                      << std::endl;
+        }
     }
+
+    if (mismatched > 0)
+        std::cout << "File transfer failed for " << mismatched
+                  << " receivers. Retrying..." << std::endl;
+    else
+        std::cout << "File transfer complete. (Time "
+                  << FLOAT(duration.count()) / 1000000.0f
+                  << "s, Speed: " << speed << " kB/s, " << f_pckt_n
+                  << " packets, " << verified << " of "
+                  << mcast_transm.receivers().size() << " receivers, "
+                  << mcast_transm.repair_count << " repairs.)" << std::endl;
+
+    return mismatched == 0;
 }
 
-void timeout_thread_main(int delay_us)
+bool stream_logic(Session &session, std::string &dest,
+                  const SessionParams &offer, ChunkCache &cache,
+                  uint32_t reader)
 {
-    while (!stop) {
-        std::this_thread::sleep_for(std::chrono::microseconds(delay_us));
-        MainEvent e{std::vector<std::byte>{}, 0, "", MainEventType::M_TIO};
-        main_queue.push(e);
+    using namespace std::chrono;
+
+    /* Number of packets the file requires. +1 is for checksum. */
+    uint64_t f_pckt_n = cache.chunk_count() + 1;
+
+    /* Out: the header and the file. In: the receiver's reply, if it makes
+     * it, it isn't resent. The checksum verdict comes back on an ACK. */
+    FileTransmitter file_transm{dest,      f_pckt_n + 1, 1, session,
+                                out_queue, 0,            0, f_pckt_n};
+    file_transm.cc = make_congestion_control(cc_mode);
+
+    auto start = high_resolution_clock::now();
+
+    session.ack_count = 10;
+
+    /* The first window goes out before anything comes back. */
+    file_transm.start_session(offer);
+    file_transm.start_stream_file(cache, reader);
+    file_transm.continue_stream_file();
+    file_transm.run_main_body([&file_transm](std::vector<MainEvent> _) {
+        (void)_;
+        file_transm.continue_stream_file();
+    });
+
+    if (stop)
+        return true;
+
+    auto end = high_resolution_clock::now();
+    auto duration = duration_cast<microseconds>(end - start);
+    auto speed = offer.f_size / FLOAT(duration.count()) * 1000.0f; // [kB / s]
+
+    /* Several receivers at once are told apart. */
+    std::string to = dest_ips.size() > 1 ? " to " + dest : "";
+
+    /* A partial file is as complete as the deadline allowed, a retry would
+     * miss its deadline again. */
+    bool checksum_match = file_transm.receive_checksum_confirmation_msg();
+    bool partial = file_transm.partial_verdict();
+    if (!checksum_match && !partial)
+        std::cout << "File transfer" << to << " failed. Retrying..."
+                  << std::endl;
+    else
+        std::cout << "File transfer" << to
+                  << (partial ? " partial." : " complete.") << " (Time "
+                  << FLOAT(duration.count()) / 1000000.0f
+                  << "s, Speed: " << speed << " kB/s, " << f_pckt_n
+                  << " packets, " << file_transm.expired_count
+                  << " expired.)" << std::endl;
+
+    return checksum_match || partial;
+}
+
+void fan_out_to(uint32_t reader, const SessionParams &offer,
+                ChunkCache &cache)
+{
+    /* As with a single receiver, a new session for every attempt. A
+     * receiver that fails for good doesn't take the others down. */
+    bool done = false;
+    while (!done && !stop) {
+        std::shared_ptr<Session> session = open_own_session(false);
+        out_queue.set_share(session->id, dest_weights[reader],
+                            rate_cap * 1000.0);
+        try {
+            done = stream_logic(*session, dest_ips[reader], offer, cache,
+                                reader);
+        } catch (const std::exception &e) {
+            std::cerr << "Error (" << dest_ips[reader] << "): " << e.what()
+                      << std::endl;
+            done = true;
+        }
+        sessions.close(session->id);
+        out_queue.forget_share(session->id);
+        if (!done)
+            cache.rewind(reader);
     }
+
+    cache.leave(reader);
 }
 
-/* Main sending and transmitting logic: */
+void fan_out_logic()
+{
+    using namespace std::chrono;
+    size_t size = get_file_size(f_name);
+    SessionParams offer = local_session_params(TransferMode::T_STREAM, size,
+                                               extract_file_name(f_name));
+    offer.deadline = deadline_ms;
+
+    /* The file is read, hashed and kept once for every receiver, each of
+     * which gets a session of its own. */
+    ChunkCache cache{f_name, offer.chunk_len,
+                     static_cast<uint32_t>(dest_ips.size())};
+
+    auto start = high_resolution_clock::now();
+
+    std::vector<std::thread> workers;
+    for (uint32_t i = 0; i < dest_ips.size(); ++i)
+        workers.emplace_back(fan_out_to, i, std::cref(offer),
+                             std::ref(cache));
+    for (auto &worker : workers)
+        worker.join();
+
+    if (stop)
+        return;
+
+    auto end = high_resolution_clock::now();
+    auto duration = duration_cast<microseconds>(end - start);
+    std::cout << "Fan-out complete. (Time "
+              << FLOAT(duration.count()) / 1000000.0f << "s, "
+              << dest_ips.size() << " receivers, " << cache.disk_reads()
+              << " chunk reads for " << cache.chunk_count() << " chunks.)"
+              << std::endl;
+}
+
+void pull_from(uint32_t source, Session &session, RangeSchedule &schedule,
+               const std::string &name)
+{
+    /* A source that fails, or doesn't have the file, leaves its part to the
+     * others. */
+    try {
+        /* 1. Handshake: ask for the file by name, the reply tells its size
+         * and SHA if the source has it. */
+        RttEstimator rtt;
+        SessionParams reply;
+        {
+            HeaderTransmitter header_transm{dest_ips[source], 1, 1, session,
+                                            out_queue,        0, 0};
+
+            header_transm.send_header_msg(
+                local_session_params(TransferMode::T_RANGE, 0, name));
+            header_transm.run_main_body(
+                [](std::vector<MainEvent> _) { (void)_; });
+            rtt = header_transm.rtt;
+
+            if (stop || session.closed) {
+                schedule.leave(source);
+                return;
+            }
+
+            reply = header_transm.receive_header_msg();
+        }
+
+        /* Setting the file up can fail whichever source replied. */
+        bool joined = false;
+        try {
+            joined = schedule.join(source, reply);
+        } catch (const std::exception &e) {
+            schedule.fail(e.what());
+            schedule.leave(source);
+            return;
+        }
+
+        if (!joined) {
+            std::cout << dest_ips[source]
+                      << (reply.sha.empty() ? " doesn't have \""
+                                            : " has another version of \"")
+                      << name << "\"." << std::endl;
+        } else {
+            /* 2. Pull ranges until the file is in. */
+            RangeTransmitter range_transm{dest_ips[source], session,
+                                          out_queue, schedule, source};
+            range_transm.rtt = rtt;
+
+            range_transm.start_pulling();
+            range_transm.run_main_body(
+                [&range_transm](std::vector<MainEvent> evs) {
+                    range_transm.pull_ranges(evs);
+                });
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "Error (" << dest_ips[source] << "): " << e.what()
+                  << std::endl;
+    }
+
+    schedule.leave(source);
+}
+
+/** Outcome of a pull: the file is in, it didn't match the SHA the sources
+ * gave, or there is nothing to pull it from (or to). */
+enum PullResult { P_DONE, P_MISMATCH, P_FAILED };
+
+PullResult pull_logic()
+{
+    using namespace std::chrono;
+    std::string name = extract_file_name(f_name);
+    std::cout << "Pulling \"" << name << "\" from " << dest_ips.size()
+              << " sources..." << std::endl;
+
+    /* Every source gets a session and a thread of its own, the schedule
+     * shares the file out among them. It is written to a part file, as a
+     * received one is, so a local copy stays until the pull checks out. */
+    std::vector<std::shared_ptr<Session>> pulls;
+    for (uint32_t i = 0; i < dest_ips.size(); ++i)
+        pulls.push_back(open_own_session(false));
+    std::string part_f_name = part_file_name(pulls[0]->id);
+    RangeSchedule schedule{part_f_name,
+                           static_cast<uint32_t>(dest_ips.size())};
+    std::vector<std::thread> workers;
+
+    auto start = high_resolution_clock::now();
+
+    for (uint32_t i = 0; i < dest_ips.size(); ++i) {
+        out_queue.set_share(pulls[i]->id, dest_weights[i], rate_cap * 1000.0);
+        workers.emplace_back(pull_from, i, std::ref(*pulls[i]),
+                             std::ref(schedule), std::cref(name));
+    }
+
+    /* Sources still in the handshake aren't needed any more. */
+    schedule.wait_done();
+    MainEvent wake{std::vector<std::byte>{}, 0, "", MainEventType::M_TIO};
+    for (uint32_t i = 0; i < pulls.size(); ++i) {
+        if (!schedule.joined(i)) {
+            sessions.close(pulls[i]->id);
+            pulls[i]->main_queue.push(wake);
+        }
+    }
+    for (auto &worker : workers)
+        worker.join();
+    for (auto &session : pulls) {
+        sessions.close(session->id);
+        out_queue.forget_share(session->id);
+    }
+
+    std::error_code ec;
+    if (stop) {
+        std::filesystem::remove(part_f_name, ec);
+        return PullResult::P_DONE;
+    }
+
+    if (!schedule.failure().empty()) {
+        std::filesystem::remove(part_f_name, ec);
+        std::cerr << "Error: " << schedule.failure() << std::endl;
+        return PullResult::P_FAILED;
+    }
+
+    if (!schedule.complete()) {
+        std::filesystem::remove(part_f_name, ec);
+        std::cout << "File pull failed, no source left to pull \"" << name
+                  << "\" from." << std::endl;
+        return PullResult::P_FAILED;
+    }
+
+    auto end = high_resolution_clock::now();
+    auto duration = duration_cast<microseconds>(end - start);
+    auto speed = schedule.file_size() / FLOAT(duration.count()) *
+                 1000.0f; // [kB / s]
+
+    bool checksum_match = get_sha(part_f_name) == schedule.sha();
+    if (checksum_match)
+        std::filesystem::rename(part_f_name, name);
+    else
+        std::filesystem::remove(part_f_name, ec);
+
+    if (!checksum_match) {
+        std::cout << "File pull failed. Retrying..." << std::endl;
+    } else {
+        std::cout << "File pull complete. (Time "
+                  << FLOAT(duration.count()) / 1000000.0f
+                  << "s, Speed: " << speed << " kB/s, "
+                  << schedule.chunk_count() << " chunks:";
+        for (uint32_t i = 0; i < dest_ips.size(); ++i)
+            std::cout << (i > 0 ? "," : "") << " " << schedule.delivered(i)
+                      << " from " << dest_ips[i];
+        std::cout << ".)" << std::endl;
+    }
+
+    return checksum_match ? PullResult::P_DONE : PullResult::P_MISMATCH;
+}
+
+bool serving_logic(Session &session, const SessionParams &agreed,
+                   std::string &dest)
+{
+    if (agreed.sha.empty()) {
+        std::cout << dest << " asked for \"" << agreed.f_name
+                  << "\", which isn't "
+                  << (serving ? "here." : "served, see \"serve\".")
+                  << std::endl;
+        return false;
+    }
+
+    std::cout << "Serving file \"" << agreed.f_name << "\" ("
+              << static_cast<float>(agreed.f_size) / 1000.0f << " kB) to "
+              << dest << "..." << std::endl;
+
+    /* Whatever ranges the puller asks for, until it says it's done. */
+    RangeTransmitter range_transm{dest, session, out_queue};
+    range_transm.start_serving(agreed.f_name, agreed);
+    range_transm.run_main_body([&range_transm](std::vector<MainEvent> evs) {
+        range_transm.serve_ranges(evs);
+    });
+
+    if (stop || session.closed)
+        return false;
+
+    std::cout << "File served, " << range_transm.served_count
+              << " chunks of \"" << agreed.f_name << "\" to " << dest << "."
+              << std::endl;
+    return true;
+}
+
+void describe_served_file(SessionParams &agreed)
+{
+    /* Only files in the working directory are served, whatever path was
+     * asked for, and no hidden ones, and only by a listener told to serve.
+     * Without a SHA the reply says the file isn't here. */
+    agreed.f_name = local_file_name(agreed.f_name);
+    agreed.f_size = 0;
+    agreed.sha.clear();
+    if (!serving || agreed.f_name.empty() ||
+        !std::filesystem::is_regular_file(agreed.f_name))
+        return;
+
+    agreed.f_size = get_file_size(agreed.f_name);
+    agreed.sha = get_sha(agreed.f_name);
+}
 
-bool sending_logic()
+bool sending_logic(Session &session)
 {
     using namespace std::chrono;
     size_t size = get_file_size(f_name);
+    SessionParams offer = local_session_params(transfer_mode, size,
+                                               extract_file_name(f_name));
+    offer.deadline = deadline_ms;
+
+    /* Small files: the file and its SHA go in the header, the ACK of it
+     * brings back the verdict. */
+    if (transfer_mode == TransferMode::T_STREAM && fits_inline(offer)) {
+        FileTransmitter file_transm{dest_ip,   1, 0, session,
+                                    out_queue, 0, 0, 0};
+        file_transm.cc = make_congestion_control(cc_mode);
+
+        std::string sha = get_sha(f_name);
+
+        auto start = high_resolution_clock::now();
+
+        file_transm.start_inline_file(offer, f_name, sha);
+        file_transm.run_main_body([&file_transm](std::vector<MainEvent> _) {
+            (void)_;
+            file_transm.continue_inline_file();
+        });
+
+        if (stop)
+            return true;
+
+        auto end = high_resolution_clock::now();
+        auto duration = duration_cast<microseconds>(end - start);
+
+        bool checksum_match = file_transm.receive_checksum_confirmation_msg();
+        if (!checksum_match)
+            std::cout << "File transfer failed. Retrying..." << std::endl;
+        else
+            std::cout << "File transfer complete. (Time "
+                      << FLOAT(duration.count()) / 1000000.0f
+                      << "s, inline.)" << std::endl;
+
+        return checksum_match;
+    }
+
+    /* Stream mode: the header and the first window of data go out in one
+     * flight, in the offered chunk length and window. */
+    if (transfer_mode == TransferMode::T_STREAM) {
+        ChunkCache cache{f_name, offer.chunk_len, 1};
+        return stream_logic(session, dest_ip, offer, cache, 0);
+    }
+
+    /* RTT estimate carried over from the header to the fountain phase. */
+    RttEstimator rtt;
+    SessionParams agreed;
 
-    /* 1. Send header: Info about file (name, size) */
+    /* 1. Handshake: offer the session (file name, size, parameters), get
+     * back what the receiver agreed to. Symbols depend on the agreed
+     * symbol length, so they wait for it. */
     {
-        HeaderTransmitter header_transm{dest_ip,   1, 0, main_queue,
+        HeaderTransmitter header_transm{dest_ip,   1, 1, session,
                                         out_queue, 0, 0};
 
-        header_transm.send_header_msg(extract_file_name(f_name), size);
+        header_transm.send_header_msg(offer);
         header_transm.run_main_body([](std::vector<MainEvent> _) { (void)_; });
+        rtt = header_transm.rtt;
 
         if (stop)
             return true;
+
+        agreed = header_transm.receive_header_msg();
     }
 
-    /* 2. Send file + receive confirmation of checksum */
+    /* 2. Send symbols + receive confirmation of checksum */
     {
-        /* Number of packets the file requires. +1 is for checksum. */
-        uint32_t f_pckt_n = (uint32_t)ceil(size / (float)DATA_LEN) + 1;
-
-        FileTransmitter file_transm{dest_ip,   f_pckt_n, 1, main_queue,
-                                    out_queue, 1,        0, f_pckt_n};
+        /* Out: SHA, in: checksum confirmation. Symbols aren't counted. */
+        FountainTransmitter fountain_transm{
+            dest_ip, 1, 1, session, out_queue, 1, 1, size, agreed.chunk_len};
+        fountain_transm.rtt = rtt;
 
         std::string sha = get_sha(f_name);
 
         auto start = high_resolution_clock::now();
 
-        ack_count = 10;
+        session.ack_count = 10;
 
-        file_transm.start_stream_file(f_name, DATA_LEN);
-        file_transm.run_main_body(
-            [&file_transm, &sha](std::vector<MainEvent> _) {
+        fountain_transm.start_stream_symbols(f_name, sha);
+        fountain_transm.run_main_body(
+            [&fountain_transm](std::vector<MainEvent> _) {
                 (void)_;
-                file_transm.continue_stream_file(DATA_LEN, sha);
+                fountain_transm.continue_stream_symbols();
             });
 
         if (stop)
@@ -146,82 +683,208 @@ bool sending_logic()
         auto duration = duration_cast<microseconds>(end - start);
         auto speed = size / FLOAT(duration.count()) * 1000.0f; // [kB / s]
 
-        bool checksum_match = file_transm.receive_checksum_confirmation_msg();
+        bool checksum_match =
+            fountain_transm.receive_checksum_confirmation_msg();
         if (!checksum_match)
             std::cout << "File transfer failed. Retrying..." << std::endl;
         else
             std::cout << "File transfer complete. (Time "
                       << FLOAT(duration.count()) / 1000000.0f
-                      << "s, Speed: " << speed << " kB/s, " << f_pckt_n
-                      << " packets.)" << std::endl;
+                      << "s, Speed: " << speed << " kB/s, fountain mode.)"
+                      << std::endl;
 
         return checksum_match;
     }
 }
 
-bool receiving_logic()
+std::string part_file_name(uint32_t session_id)
+{
+    /* Hidden, so it is never served or taken for a finished file. */
+    return ".udp_comms." + std::to_string(session_id) + ".part";
+}
+
+bool receiving_logic(Session &session)
 {
-    /* 1. Receive header: Info about file (name, size) */
+    /* 1. Handshake: receive the sender's offer (file name, size,
+     * parameters), reply with what this end agrees to. In stream mode data
+     * comes along with the offer, it waits in the main queue meanwhile. */
 
     std::string in_f_name{""};
+    std::string part_f_name{""};
     std::string src_ip{""};
     size_t in_size{0};
-    uint32_t f_pckt_n{0};
+    TransferMode t_mode{TransferMode::T_STREAM};
+    SessionParams agreed;
+    uint64_t f_pckt_n{0};
     bool checksum_match{false};
+    bool partial{false};
+    RttEstimator rtt;
     {
-        HeaderTransmitter header_transm{1, main_queue, out_queue, 0, 0};
-        header_transm.run_main_body([](std::vector<MainEvent> _) { (void)_; });
+        /* The reply needs ACKs, so this sends to wherever the offer came
+         * from. */
+        HeaderTransmitter header_transm{src_ip,    1, 1, session,
+                                        out_queue, 0, 0};
+        bool replied = false;
+        header_transm.run_main_body(
+            [&header_transm, &agreed, &replied](std::vector<MainEvent> _) {
+                (void)_;
+                if (replied || header_transm.recvd_ids.size() == 0)
+                    return;
+
+                SessionParams offer = header_transm.receive_header_msg();
+                agreed = negotiate_session(
+                    offer,
+                    local_session_params(offer.t_mode, offer.f_size, ""));
+
+                /* The refusal is the reply, the sender stops right away. */
+                if (agreed.t_mode == TransferMode::T_STREAM &&
+                    agreed.chunk_len != offer.chunk_len) {
+                    header_transm.dest_ip = header_transm.src_ip;
+                    header_transm.send_header_reply(agreed);
+                    throw std::runtime_error(
+                        "Offered chunk length is too large.");
+                }
+
+                /* Nothing is written outside the working directory. */
+                if (agreed.t_mode == TransferMode::T_RANGE) {
+                    describe_served_file(agreed);
+                } else {
+                    agreed.f_name = local_file_name(offer.f_name);
+                    if (agreed.f_name.empty())
+                        throw std::runtime_error("Refused file name \"" +
+                                                 offer.f_name + "\".");
+                }
+
+                header_transm.dest_ip = header_transm.src_ip;
+                header_transm.send_header_reply(agreed);
+                replied = true;
+            });
         src_ip = header_transm.src_ip;
-        if (stop)
-            return true;
-
-        header_transm.receive_header_msg(in_f_name, in_size);
+        rtt = header_transm.rtt;
+        if (stop || session.closed)
+            return false;
+
+        /* A pull only needs the file served, the puller checks it. */
+        if (agreed.t_mode == TransferMode::T_RANGE)
+            return serving_logic(session, agreed, src_ip);
+
+        in_f_name = agreed.f_name;
+        part_f_name = part_file_name(session.id);
+        in_size = agreed.f_size;
+        t_mode = agreed.t_mode;
         std::cout << "Receiving file \"" << in_f_name << "\" ("
                   << static_cast<float>(in_size) / 1000.0f << " kB) from "
                   << src_ip << "..." << std::endl;
     }
 
     /* 2. Receive file */
-    {
+    if (t_mode == TransferMode::T_INLINE) {
+        /* It came in the header, as message 0. */
+        std::ofstream file_o{part_f_name, std::ios::binary | std::ios::out};
+        if (!file_o.is_open())
+            throw std::runtime_error("Couldn't open file for writing :( ");
+        file_o.write(reinterpret_cast<const char *>(agreed.content.data()),
+                     agreed.content.size());
+        file_o.close();
+
+        checksum_match = get_sha(part_f_name) == agreed.sha;
+    } else if (t_mode == TransferMode::T_FOUNTAIN) {
+        /* In: SHA (ID 1). Done once the symbols decode the whole file. */
+        f_pckt_n = 1;
+        FountainTransmitter fountain_transm{
+            1, session, out_queue, 0, 1, in_size, agreed.chunk_len};
+
+        fountain_transm.run_main_body(
+            [&fountain_transm](std::vector<MainEvent> ev) {
+                fountain_transm.receive_symbols(ev);
+            });
+
+        if (stop || session.closed)
+            return false;
+
+        fountain_transm.write_file(part_f_name);
+
+        std::string dest_md5 = get_sha(part_f_name);
+        std::string src_md5 = fountain_transm.receive_checksum_msg();
+        checksum_match = dest_md5 == src_md5;
+    } else {
         /* Number of packets the file requires. +1 is for checksum. */
-        f_pckt_n = (uint32_t)ceil(in_size / (float)DATA_LEN) + 1;
-        FileTransmitter file_transm{f_pckt_n, main_queue, out_queue,
+        const size_t chunk = agreed.chunk_len;
+        f_pckt_n = (in_size + chunk - 1) / chunk + 1;
+        FileTransmitter file_transm{f_pckt_n, session, out_queue,
                                     0,        1,          f_pckt_n};
 
-        file_transm.prep_receive_file(in_f_name);
+        file_transm.apply_session(agreed);
+        session.ack_count = agreed.ack_copies;
+        file_transm.prep_receive_file(part_f_name, in_size);
         file_transm.run_main_body([&file_transm](std::vector<MainEvent> ev) {
             file_transm.receive_stream_file(ev);
         });
 
-        if (stop)
-            return true;
+        if (stop || session.closed)
+            return false;
 
-        /* Important for checksum to calculate correctly. */
         file_transm.close_write_file();
 
-        std::string dest_md5 = get_sha(in_f_name);
+        std::string dest_md5 = file_transm.file_sha();
         std::string src_md5 = file_transm.receive_checksum_msg();
         checksum_match = dest_md5 == src_md5;
+
+        /* Packets past the deadline were given up on by both ends, the file
+         * can't match then. It is as complete as the deadline allowed, that
+         * is what the verdict says: partial, not verified. */
+        uint64_t skipped = file_transm.skipped_packets();
+        if (skipped > 0) {
+            std::cout << skipped << " packets skipped past the deadline."
+                      << std::endl;
+            partial = !checksum_match;
+        }
     }
 
+    /* The file only takes its name once it checks out, concurrent
+     * transfers of the same name each write a part file of their own. The
+     * last one in wins. */
+    if (checksum_match || partial)
+        std::filesystem::rename(part_f_name, in_f_name);
+
     /* 3. Send positive/negative checksum confirm */
-    {
+    if (t_mode != TransferMode::T_FOUNTAIN) {
+        /* On ACKs of the checksum message (the header of an inline file),
+         * for as long as it comes in. */
         ChecksumTransmitter chcksum_transm{
-            src_ip, 1, 0, main_queue, out_queue, 0, f_pckt_n + 1};
+            src_ip, 0, 0, session, out_queue, 0, f_pckt_n};
+        chcksum_transm.rtt = rtt;
+
+        chcksum_transm.send_checksum_verdict(
+            f_pckt_n, checksum_match ? ACK_VERIFIED
+                      : partial      ? ACK_PARTIAL
+                                     : ACK_MISMATCH);
+        chcksum_transm.run_main_body(
+            [&chcksum_transm](std::vector<MainEvent> evs) {
+                chcksum_transm.linger_verdict(evs);
+            });
+    } else {
+        ChecksumTransmitter chcksum_transm{
+            src_ip, 1, 0, session, out_queue, 0, f_pckt_n + 1};
 
         chcksum_transm.send_checksum_confirmation_msg(checksum_match);
         chcksum_transm.run_main_body([](std::vector<MainEvent> _) { (void)_; });
+    }
 
-        if (stop)
-            return true;
+    if (stop || session.closed)
+        return false;
 
-        if (!checksum_match)
-            std::cout << "File transfer failed. Retrying..." << std::endl;
-        else
-            std::cout << "File transfer complete." << std::endl;
+    if (partial)
+        std::cout << "File transfer partial, \"" << in_f_name
+                  << "\" received up to the deadline." << std::endl;
+    else if (!checksum_match)
+        std::cout << "File transfer failed, \"" << in_f_name
+                  << "\" is sent again." << std::endl;
+    else
+        std::cout << "File transfer complete, \"" << in_f_name
+                  << "\" received." << std::endl;
 
-        return checksum_match;
-    }
+    return checksum_match;
 }
 
 int main(int argc, char *argv[])
@@ -230,16 +893,46 @@ int main(int argc, char *argv[])
 
     std::thread out_thread{out_thread_main};
     std::thread in_thread{in_thread_main};
-    std::thread timeout_thread{timeout_thread_main, RESEND_DELAY};
+    std::thread timeout_thread{timeout_thread_main};
 
     setup_sigint_handler();
 
-    bool done = false;
-    do {
-        next_id = 0;
-        ack_count = 1;
-        done = sending ? sending_logic() : receiving_logic();
-    } while (!done);
+    bool failed = false; /* The transfer was given up on. */
+    if (sending && transfer_mode == TransferMode::T_RANGE) {
+        /* Pulled again from the start only on a mismatch, a few times. */
+        PullResult result = PullResult::P_MISMATCH;
+        for (uint32_t i = 0;
+             i < PULL_ATTEMPTS && result == PullResult::P_MISMATCH; ++i)
+            result = pull_logic();
+        if (result == PullResult::P_MISMATCH)
+            std::cout << "File pull failed " << PULL_ATTEMPTS
+                      << " times, given up." << std::endl;
+        failed = result != PullResult::P_DONE;
+    } else if (sending && dest_ips.size() > 1) {
+        fan_out_logic();
+    } else if (sending) {
+        /* A new session for every attempt, whatever is left of the last one
+         * is ignored on both ends. */
+        bool done = false;
+        do {
+            std::shared_ptr<Session> session = open_own_session(multicast);
+
+            /* Multicast has nothing to adapt its rate to. */
+            uint32_t rate = rate_cap == 0 && multicast ? MCAST_RATE : rate_cap;
+            out_queue.set_share(session->id, dest_weights[0], rate * 1000.0);
+            try {
+                done = multicast ? multicast_logic(*session)
+                                 : sending_logic(*session);
+            } catch (const std::exception &e) {
+                std::cerr << "Error: " << e.what() << std::endl;
+                done = failed = true;
+            }
+            sessions.close(session->id);
+            out_queue.forget_share(session->id);
+        } while (!done);
+    } else {
+        serve_sessions();
+    }
 
     terminate(0);
 
@@ -248,7 +941,7 @@ int main(int argc, char *argv[])
     timeout_thread.join();
 
     std::cout << "Bye!" << std::endl;
-    return 0;
+    return failed ? 1 : 0;
 };
 
 /**************************************************************************/
@@ -257,11 +950,74 @@ int main(int argc, char *argv[])
 
 void process_args(int argc, char *argv[])
 {
-    if (argc == 3) {
+    if (argc >= 3) {
         std::cout << "IP and file name specified, sending file." << std::endl;
         dest_ip = argv[1];
         f_name = argv[2];
         sending = true;
+        for (int i = 3; i < argc; ++i) {
+            std::string opt{argv[i]};
+            if (opt == "fountain") {
+                transfer_mode = TransferMode::T_FOUNTAIN;
+            } else if (opt == "pull") {
+                transfer_mode = TransferMode::T_RANGE;
+            } else if (!parse_number_option(opt, "deadline", deadline_ms) &&
+                       !parse_number_option(opt, "receivers",
+                                            mcast_receivers) &&
+                       !parse_number_option(opt, "rate", rate_cap) &&
+                       !parse_number_option(opt, "max-rate", max_rate) &&
+                       !parse_congestion_mode(opt, cc_mode)) {
+                std::cout << "Error: Unknown option \"" << opt
+                          << "\", use \"cubic\", \"bbr\", \"ledbat\", "
+                          << "\"fountain\", \"pull\", \"deadline=<ms>\", "
+                          << "\"rate=<kB/s>\", "
+                          << "\"max-rate=<kB/s>\" or "
+                          << "\"receivers=<n>\"." << std::endl;
+                exit(1);
+            }
+        }
+        out_queue.set_rate(max_rate * 1000.0);
+
+        /* A comma separated list fans out to all of them, or is pulled
+         * from. Each one may be given its share of the link against the
+         * others, as "<ip>:<weight>". */
+        std::stringstream list{dest_ip};
+        for (std::string ip; std::getline(list, ip, ',');) {
+            uint32_t weight = 1;
+            size_t colon = ip.find(':');
+            if (colon != std::string::npos &&
+                (!parse_number_option("weight=" + ip.substr(colon + 1),
+                                      "weight", weight) ||
+                 weight == 0)) {
+                std::cout << "Error: Bad weight in \"" << ip
+                          << "\", use \"<ip>:<n>\" with n > 0." << std::endl;
+                exit(1);
+            }
+            dest_ips.push_back(ip.substr(0, colon));
+            dest_weights.push_back(weight);
+        }
+        if (dest_ips.empty()) {
+            std::cout << "Error: No IP address given." << std::endl;
+            exit(1);
+        }
+        dest_ip = dest_ips[0];
+        if (dest_ips.size() > 1 &&
+            (transfer_mode == TransferMode::T_FOUNTAIN ||
+             std::any_of(dest_ips.begin(), dest_ips.end(), is_multicast_ip))) {
+            std::cout << "Error: \"fountain\" and multicast groups don't go "
+                      << "with a list of receivers." << std::endl;
+            exit(1);
+        }
+
+        /* A multicast group gets the data once, for all its receivers. */
+        multicast = is_multicast_ip(dest_ip);
+        if (multicast && (transfer_mode != TransferMode::T_STREAM ||
+                          deadline_ms > 0)) {
+            std::cout << "Error: \"fountain\", \"pull\" and "
+                      << "\"deadline=<ms>\" don't go with a multicast group."
+                      << std::endl;
+            exit(1);
+        }
     } else if (argc == 1) {
         std::cout << "No file name or IP specified, listening..." << std::endl;
         std::string own_ip = get_own_ip_addr();
@@ -269,16 +1025,120 @@ void process_args(int argc, char *argv[])
         if (own_ip != ":(")
             std::cout << "Send files to IP: " << own_ip
                       << " to receive them here." << std::endl;
+    } else if (argc == 2 && std::string{argv[1]} == "serve") {
+        std::cout << "Serving files, listening..." << std::endl;
+        serving = true;
+        sending = false;
+        std::cout << "Files here may be pulled by anyone who can reach this "
+                  << "host." << std::endl;
+    } else if (argc == 2 && is_multicast_ip(argv[1])) {
+        std::cout << "Multicast group specified, listening..." << std::endl;
+        mcast_group = argv[1];
+        sending = false;
+        std::cout << "Send files to group " << mcast_group
+                  << " to receive them here." << std::endl;
     } else {
         std::cout << "Error: Wrong number of arguments." << std::endl;
-        std::cout << "Provide no arguments to listen for files." << std::endl;
+        std::cout << "Provide no arguments to listen for files, a"
+                  << " multicast group to listen in it too, or \"serve\""
+                  << " to also let files here be pulled." << std::endl;
+        std::cout << "OR" << std::endl;
+        std::cout << "Provide IP address and file name to transmit a file,"
+                  << " a multicast group to send it to all its receivers,"
+                  << " or comma separated IPs to send it to each of them."
+                  << std::endl;
         std::cout << "OR" << std::endl;
-        std::cout << "Provide IP address and file name to transmit a file."
+        std::cout << "Provide comma separated IPs, a file name and \"pull\""
+                  << " to fetch the file from all of them at once."
+                  << std::endl;
+        std::cout << "Each IP of a list may be given as \"<ip>:<n>\", its"
+                  << " weight in sharing the link with the others."
                   << std::endl;
+        std::cout << "Optionally followed by congestion control (cubic, bbr,"
+                  << " ledbat) or \"fountain\" for a rateless transfer,"
+                  << " \"deadline=<ms>\" to drop data that late, and"
+                  << " \"rate=<kB/s>\" or \"max-rate=<kB/s>\" to cap the"
+                  << " rate of the transfer or of all of them, and"
+                  << " \"receivers=<n>\" to wait for that many receivers of"
+                  << " a group." << std::endl;
         exit(1);
     }
 }
 
+bool parse_number_option(const std::string &opt, const std::string &name,
+                         uint32_t &value)
+{
+    /* "name=<digits>" */
+    const size_t from = name.size() + 1;
+    if (opt.size() <= from || opt.compare(0, from, name + "=") != 0 ||
+        opt.find_first_not_of("0123456789", from) != std::string::npos)
+        return false;
+
+    value = static_cast<uint32_t>(std::stoul(opt.substr(from)));
+    return true;
+}
+
+std::shared_ptr<Session> open_own_session(bool multicast)
+{
+    /* Random IDs, so a sender started again doesn't run into the sessions
+     * of the last run. The top bit tells receivers a group's from the
+     * others. */
+    static std::random_device random;
+    bool opened = false;
+    std::shared_ptr<Session> session;
+    while (!opened) {
+        uint32_t id = random();
+        id = multicast ? id | MCAST_SESSION_BIT : id & ~MCAST_SESSION_BIT;
+        session = sessions.open(id, opened);
+    }
+    session->multicast = multicast;
+
+    return session;
+}
+
+void serve_session(std::shared_ptr<Session> session)
+{
+    /* A failed transfer shouldn't take the others down, nor leave its part
+     * file behind. */
+    try {
+        receiving_logic(*session);
+    } catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+    }
+    std::error_code ec;
+    std::filesystem::remove(part_file_name(session->id), ec);
+    sessions.close(session->id);
+
+    /* Wakes serve_sessions up to join this thread. */
+    opened_sessions.push(nullptr);
+}
+
+void serve_sessions()
+{
+    /* Every session a peer opens gets a thread of its own, until exit. A
+     * finished one is joined as soon as it says so. */
+    std::vector<std::pair<std::shared_ptr<Session>, std::thread>> workers;
+    while (!stop) {
+        for (auto &session : opened_sessions.wait_nonempty()) {
+            if (session)
+                workers.emplace_back(session,
+                                     std::thread{serve_session, session});
+        }
+
+        for (auto it = workers.begin(); it != workers.end();) {
+            if (it->first->closed) {
+                it->second.join();
+                it = workers.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    for (auto &worker : workers)
+        worker.second.join();
+}
+
 std::string get_own_ip_addr()
 {
     int sockfd;
@@ -323,7 +1183,8 @@ void terminate(int s)
                   << std::endl;
 
     stop = true;
-    main_queue.cond.notify_all();
+    sessions.notify_all();
+    opened_sessions.cond.notify_all();
     out_queue.cond.notify_all();
 }
 
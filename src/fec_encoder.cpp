@@ -0,0 +1,53 @@
+#include "fec_encoder.h"
+#include <algorithm>
+
+uint32_t FecEncoder::block_len(double loss_rate)
+{
+    if (loss_rate < FEC_MIN_LOSS)
+        return 0;
+
+    uint32_t k = static_cast<uint32_t>(1.0 / (4.0 * loss_rate));
+    return std::clamp<uint32_t>(k, FEC_MIN_K, FEC_MAX_K);
+}
+
+void FecEncoder::add(uint64_t id, const std::vector<std::byte> &data,
+                     uint32_t k, std::vector<FecParity> &parities)
+{
+    FecParity closed;
+
+    /* A block only holds packets of the same length. */
+    if (count > 0 && data.size() != parity.size() && close(closed))
+        parities.push_back(std::move(closed));
+
+    if (k == 0) {
+        if (close(closed))
+            parities.push_back(std::move(closed));
+        return;
+    }
+
+    if (count == 0) {
+        first = id;
+        parity.assign(data.size(), std::byte{0});
+    }
+    for (size_t i = 0; i < data.size(); ++i)
+        parity[i] ^= data[i];
+
+    if (++count >= k && close(closed))
+        parities.push_back(std::move(closed));
+}
+
+bool FecEncoder::close(FecParity &closed)
+{
+    if (count == 0)
+        return false;
+
+    uint16_t k = static_cast<uint16_t>(count);
+    closed.first = first;
+    closed.content.resize(FEC_HEADER_LEN + parity.size());
+    memcpy(&closed.content[0], &k, sizeof(k));
+    if (!parity.empty())
+        memcpy(&closed.content[FEC_HEADER_LEN], &parity[0], parity.size());
+
+    count = 0;
+    return true;
+}
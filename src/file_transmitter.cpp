@@ -1,62 +1,118 @@
 #include "file_transmitter.h"
 #include <algorithm>
 
-#define CHKSUM_MSG_INV "Invalid checksum confirmation: insufficient data."
-#define CHKSUM_DATA_INV "Expected checksum confirmation, got something else."
+/* Probes for a checksum verdict before giving up on the receiver. */
+#define VERDICT_PROBES 10
 
 FileTransmitter::FileTransmitter(std::string &dest_ip, size_t out_msg_count,
                                  size_t in_msg_count,
-                                 Queue<MainEvent> &main_queue,
-                                 Queue<OutEvent> &out_queue,
-                                 uint32_t min_ack_id, uint32_t min_msg_id,
-                                 uint32_t f_pckt_n)
-    : Transmitter{dest_ip,   out_msg_count, in_msg_count, main_queue,
-                  out_queue, min_ack_id,    min_msg_id}
+                                 Session &session,
+                                 OutQueue &out_queue,
+                                 uint64_t min_ack_id, uint64_t min_msg_id,
+                                 uint64_t f_pckt_n)
+    : Transmitter{dest_ip,   out_msg_count, in_msg_count, session,
+                  out_queue, min_ack_id,    min_msg_id},
+      stored_ids{min_msg_id}
 {
     next_packet_id_to_write = min_msg_id;
+    next_expected_id = min_msg_id;
     this->f_pckt_n = f_pckt_n;
 }
 
 FileTransmitter::FileTransmitter(size_t in_msg_count,
-                                 Queue<MainEvent> &main_queue,
-                                 Queue<OutEvent> &out_queue,
-                                 uint32_t min_ack_id, uint32_t min_msg_id,
-                                 uint32_t f_pckt_n)
-    : Transmitter{in_msg_count, main_queue, out_queue, min_ack_id, min_msg_id}
+                                 Session &session,
+                                 OutQueue &out_queue,
+                                 uint64_t min_ack_id, uint64_t min_msg_id,
+                                 uint64_t f_pckt_n)
+    : Transmitter{in_msg_count, session, out_queue, min_ack_id, min_msg_id},
+      stored_ids{min_msg_id}
 {
     next_packet_id_to_write = min_msg_id;
+    next_expected_id = min_msg_id;
     this->f_pckt_n = f_pckt_n;
 }
 
 FileTransmitter::~FileTransmitter()
 {
-    if (file_o.is_open()) {
-        file_o.close();
-    }
+    close_write_file();
+}
+
+void FileTransmitter::apply_session(const SessionParams &params)
+{
+    chunk_len = params.chunk_len;
+    flow_window = params.window;
+    fec_enabled = params.options & SESSION_OPT_FEC;
+    nack_enabled = params.options & SESSION_OPT_NACK;
+    msg_deadline = static_cast<int64_t>(params.deadline) * 1000;
+
+    /* The reply may agree on a smaller window than the offer's the first
+     * flight went out in. */
+    if (mode == TransmitterMode::SEND)
+        peer_limit = std::min(peer_limit, min_ack_id + flow_window);
+    else if (mode == TransmitterMode::RECEIVE)
+        session.recv_limit = min_msg_id + flow_window;
+}
+
+void FileTransmitter::start_session(const SessionParams &offer)
+{
+    /* Until the reply, the receiver buffers up to the offered window. */
+    apply_session(offer);
+    std::vector<std::byte> data = encode_session(offer);
+    send_msg(data);
+}
+
+void FileTransmitter::apply_reply()
+{
+    if (reply_applied || !recvd_ids.contains(min_msg_id))
+        return;
+
+    /* Data in the offered chunk length is out already. */
+    SessionParams reply = decode_session(recvd_msgs[min_msg_id]);
+    if (reply.chunk_len != chunk_len)
+        throw std::runtime_error("Receiver refused the chunk length :(");
+
+    apply_session(reply);
+    reply_applied = true;
+}
+
+void FileTransmitter::start_stream_file(ChunkCache &cache, uint32_t reader)
+{
+    this->cache = &cache;
+    cache_reader = reader;
+    next_chunk = 0;
 }
 
-void FileTransmitter::start_stream_file(const std::string &filename,
-                                        std::size_t chunk_size)
+void FileTransmitter::start_inline_file(SessionParams offer,
+                                        const std::string &filename,
+                                        const std::string &sha)
 {
     file = std::ifstream{filename, std::ios::binary};
     if (!file.is_open())
         throw std::runtime_error("Couldn't open file :( " + filename);
 
-    std::vector<std::byte> buffer{chunk_size};
-    file.read(reinterpret_cast<char *>(buffer.data()), chunk_size);
-    std::size_t bytes_read = file.gcount();
+    offer.t_mode = TransferMode::T_INLINE;
+    offer.sha = sha;
+    offer.content.resize(offer.f_size);
+    file.read(reinterpret_cast<char *>(offer.content.data()), offer.f_size);
+    if (static_cast<size_t>(file.gcount()) != offer.f_size)
+        throw std::runtime_error("Couldn't read file :( " + filename);
+    file.close();
 
-    if (bytes_read == chunk_size)
-        send_msg(buffer);
-    else if (bytes_read > 0 && bytes_read < chunk_size) {
-        std::vector<std::byte> data{bytes_read};
-        memcpy(&data[0], &buffer[0], bytes_read);
-        send_msg(data);
-    }
+    /* The header is the checksum message too, probed the same way. */
+    checksum_content = encode_session(offer);
+    send_msg(checksum_content);
+    this->sent_checksum = true;
+    probe_at = std::chrono::high_resolution_clock::now();
+}
+
+void FileTransmitter::continue_inline_file()
+{
+    if (did_receive_checksum_confirmation())
+        this->done = true;
+    probe_verdict();
 }
 
-void FileTransmitter::continue_stream_file(std::size_t chunk_size,
-                                           std::string &sha)
+void FileTransmitter::continue_stream_file()
 {
     /* If we already got checksum confirmation, it means all content
      * messages arrived even if we didn't get acks back. */
@@ -64,131 +120,460 @@ void FileTransmitter::continue_stream_file(std::size_t chunk_size,
         this->done = true;
     }
 
-    int ackd = 0;
-    for (auto &msg : sent_msgs) {
-        ackd += static_cast<int>(msg.second.ackd);
+    apply_reply();
+
+    if (this->sent_checksum) {
+        probe_verdict();
+        return;
     }
-    int in_the_air = static_cast<int>(sent_msgs.size()) - ackd;
 
-    if (file.tellg() == -1) {
-        if (this->sent_checksum) {
-            return;
-        }
-        std::vector<std::byte> data;
-        data.reserve(sha.size());
-        for (char c : sha) {
-            data.push_back(std::byte{static_cast<unsigned char>(c)});
-        }
-        send_msg(data);
-        this->sent_checksum = true;
+    /* Fill up to the congestion window, as fast as pacing allows. */
+    while (may_send() && next_chunk < cache->chunk_count())
+        send_data(cache->take(cache_reader, next_chunk++));
+
+    if (next_chunk < cache->chunk_count())
         return;
+
+    /* Protect the tail too, it is the most expensive part to lose. */
+    FecParity tail;
+    if (fec.close(tail))
+        send_parity(tail);
+
+    /* The checksum goes right behind the last data packet. Taking that
+     * hashed the file. */
+    std::string sha = cache->sha();
+    checksum_content.reserve(sha.size());
+    for (char c : sha) {
+        checksum_content.push_back(std::byte{static_cast<unsigned char>(c)});
     }
-    std::vector<std::byte> buffer(chunk_size);
-    for (int i = 0; i < WINDOW_SIZE - in_the_air; ++i) {
-        file.read(reinterpret_cast<char *>(buffer.data()), chunk_size);
-        std::size_t bytes_read = file.gcount();
+    send_msg(checksum_content);
+    this->sent_checksum = true;
+    probe_at = std::chrono::high_resolution_clock::now();
+}
 
-        if (bytes_read == chunk_size)
-            send_msg(buffer);
-        else if (bytes_read > 0 && bytes_read < chunk_size) {
-            std::vector<std::byte> data{bytes_read};
-            memcpy(&data[0], &buffer[0], bytes_read);
-            send_msg(data);
-        }
+void FileTransmitter::send_data(Chunk chunk)
+{
+    const uint64_t id = session.next_id;
+    send_msg(chunk);
+
+    /* The header and checksum stay reliable, only data can expire. */
+    if (msg_deadline > 0) {
+        SentMessage &msg = *sent_msgs.find(id);
+        msg.expires_at = msg.sent_at + std::chrono::microseconds(msg_deadline);
     }
 
-    if (file.peek() == EOF)
-        file.close();
+    std::vector<FecParity> parities;
+    fec.add(id, *chunk, fec_enabled ? FecEncoder::block_len(loss_rate) : 0,
+            parities);
+    for (const FecParity &parity : parities)
+        send_parity(parity);
+}
+
+void FileTransmitter::send_parity(const FecParity &parity)
+{
+    OutEvent e{parity.content, parity.first, dest_ip, OutEventType::O_FEC,
+               session.id};
+    out_queue.push(e);
 }
 
-void FileTransmitter::prep_receive_file(const std::string &f_name)
+void FileTransmitter::prep_receive_file(const std::string &f_name,
+                                        size_t f_size)
 {
-    file_o.open(f_name, std::ios::binary | std::ios::out);
-    if (!file_o.is_open()) {
+    /* Read back too, for hashing packets that were written out of order. */
+    file_fd = open(f_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (file_fd < 0) {
         throw std::runtime_error("Couldn't open file for writing :( ");
     }
+
+    /* Reserve the whole file up front, packets are written at their offset.
+     * Not every file system can allocate, a sparse file does too. */
+    if (f_size > 0 && posix_fallocate(file_fd, 0, f_size) != 0 &&
+        ftruncate(file_fd, f_size) != 0) {
+        throw std::runtime_error("Couldn't size file for writing :( ");
+    }
+    file_len = f_size;
+
+    /* Gaps are checked on every tick, so tick often enough to NACK them
+     * soon after the reorder delay. */
+    session.tick_delay = NACK_REORDER_DELAY / 2;
 }
 
 void FileTransmitter::receive_stream_file(std::vector<MainEvent> evs)
 {
-    if (!file_o.is_open()) {
+    if (file_fd < 0) {
         throw std::runtime_error("File for writing not open...");
     }
 
     for (MainEvent ev : evs) {
+        if (ev.type == MainEventType::M_FEC) {
+            receive_parity(ev);
+            continue;
+        }
+
+        /* Nothing comes after the checksum, so anything still missing
+         * before it is a gap too, and gets NACKed or skipped. */
+        if (ev.type == MainEventType::M_MSG && ev.msg_id == this->f_pckt_n)
+            update_gaps(ev.msg_id);
+
         /* If not a message, below minimum ID or above max. packet ID (equal to
          * number of packets because the file packets start at 1), don't add to
          * file. */
         if (ev.type != MainEventType::M_MSG || ev.msg_id < this->min_msg_id ||
             ev.msg_id >= this->f_pckt_n ||
-            recvd_fs_msgs.find(ev.msg_id) != recvd_fs_msgs.end())
+            stored_ids.contains(ev.msg_id))
+            continue;
+
+        store_packet(ev);
+    }
+
+    skip_late_packets();
+    send_nacks();
+    update_flow_window();
+}
+
+void FileTransmitter::store_packet(MainEvent &ev)
+{
+    stored_ids.insert(ev.msg_id);
+    update_gaps(ev.msg_id);
+
+    if (stored_ids.size() % 10 == 0)
+        std::cout << "Progress: "
+                  << stored_ids.size() / (float)f_pckt_n * 100.0f << "%\r"
+                  << std::flush;
+
+    /* Keep a copy for rebuilding other packets of its FEC block. */
+    fec_cache[ev.msg_id] = ev.content;
+
+    /* Every packet but the last is chunk_len long, so each one goes straight
+     * to its own offset, in whatever order they arrive. */
+    off_t offset = static_cast<off_t>(ev.msg_id - min_msg_id) * chunk_len;
+    const auto &c = ev.content;
+    if (pwrite(file_fd, &c[0], c.size(), offset) !=
+        static_cast<ssize_t>(c.size()))
+        throw std::runtime_error("Couldn't write to file :( ");
+
+    advance_write_point(&ev);
+
+    /* Drop cached packets and parities that can't be needed any more: every
+     * packet of their block is already written. */
+    while (!fec_cache.empty() &&
+           (fec_cache.begin()->first + FEC_MAX_K < next_packet_id_to_write ||
+            fec_cache.size() > FEC_CACHE_LEN))
+        fec_cache.erase(fec_cache.begin());
+    while (!fec_parities.empty() &&
+           fec_parities.begin()->first + FEC_MAX_K < next_packet_id_to_write)
+        fec_parities.erase(fec_parities.begin());
+
+    /* This packet may leave a single hole in a block we have parity for. */
+    auto it = fec_parities.upper_bound(ev.msg_id);
+    if (it != fec_parities.begin()) {
+        --it;
+        recover_block(it->first);
+    }
+}
+
+void FileTransmitter::advance_write_point(const MainEvent *latest)
+{
+    /* Track the end of the contiguous written prefix, and hash it on the way:
+     * the file is verified as soon as its last packet is in. */
+    while (stored_ids.contains(next_packet_id_to_write)) {
+        hash_packet(next_packet_id_to_write, latest);
+        ++next_packet_id_to_write;
+    }
+}
+
+void FileTransmitter::hash_packet(uint64_t id, const MainEvent *latest)
+{
+    if (latest && id == latest->msg_id) {
+        sha.add(latest->content.data(), latest->content.size());
+        return;
+    }
+
+    /* Arrived earlier, behind a gap: read it back from the file. */
+    off_t offset = static_cast<off_t>(id - min_msg_id) * chunk_len;
+    size_t len = std::min<size_t>(chunk_len, file_len - offset);
+    std::vector<std::byte> buffer(len);
+    if (len > 0 && pread(file_fd, &buffer[0], len, offset) !=
+                       static_cast<ssize_t>(len))
+        throw std::runtime_error("Couldn't read back from file :( ");
+    sha.add(buffer.data(), len);
+}
+
+void FileTransmitter::receive_parity(MainEvent &ev)
+{
+    if (ev.content.size() <= FEC_HEADER_LEN)
+        return;
+
+    uint16_t k = 0;
+    memcpy(&k, &ev.content[0], sizeof(k));
+    if (k == 0 || ev.msg_id < this->min_msg_id ||
+        ev.msg_id + k > this->f_pckt_n || ev.msg_id + k <= next_packet_id_to_write)
+        return;
+
+    fec_parities[ev.msg_id] = ev.content;
+    recover_block(ev.msg_id);
+}
+
+void FileTransmitter::recover_block(uint64_t first)
+{
+    auto parity_it = fec_parities.find(first);
+    if (parity_it == fec_parities.end())
+        return;
+
+    const auto &parity = parity_it->second;
+    uint16_t k = 0;
+    memcpy(&k, &parity[0], sizeof(k));
+
+    /* XOR parity can rebuild exactly one missing packet. */
+    uint64_t missing_id = 0;
+    uint32_t missing = 0;
+    for (uint64_t id = first; id < first + k; ++id) {
+        if (!stored_ids.contains(id)) {
+            missing_id = id;
+            ++missing;
+        }
+    }
+
+    if (missing > 1)
+        return;
+
+    std::vector<std::byte> data{parity.begin() + FEC_HEADER_LEN, parity.end()};
+    fec_parities.erase(parity_it);
+    if (missing == 0)
+        return;
+
+    for (uint64_t id = first; id < first + k; ++id) {
+        if (id == missing_id)
+            continue;
+        auto cached = fec_cache.find(id);
+        if (cached == fec_cache.end() || cached->second.size() != data.size())
+            return;
+        for (size_t i = 0; i < data.size(); ++i)
+            data[i] ^= cached->second[i];
+    }
+
+    /* Treat the rebuilt packet as received, and ACK it so the sender doesn't
+     * resend it. The ACK tells the sender it was lost nonetheless. A
+     * multicast sender only hears about what is still missing. */
+    MainEvent ev{data, missing_id, src_ip, MainEventType::M_MSG};
+    receive_msg(ev);
+
+    OutEvent ack{make_ack(ACK_RECOVERED, session.recv_limit), missing_id,
+                 src_ip, OutEventType::O_ACK, session.id};
+    for (uint32_t i = 0; i < session.ack_count && !session.multicast; ++i)
+        out_queue.push(ack);
+
+    store_packet(ev);
+}
+
+bool FileTransmitter::keeps_content(uint64_t msg_id) const
+{
+    /* Data packets go to the file, only the checksum is kept. */
+    return mode == TransmitterMode::SEND || msg_id >= f_pckt_n;
+}
+
+void FileTransmitter::update_gaps(uint64_t msg_id)
+{
+    using namespace std::chrono;
+    auto now = high_resolution_clock::now();
+
+    /* Everything skipped over by this packet is missing for now. */
+    for (; next_expected_id < msg_id; ++next_expected_id) {
+        if (!stored_ids.contains(next_expected_id))
+            gaps[next_expected_id] = MissingPacket{
+                .seen_at = now, .nacked_at = now, .nacks = 0};
+    }
+    next_expected_id = std::max(next_expected_id, msg_id + 1);
+
+    auto gap = gaps.find(msg_id);
+    if (gap == gaps.end())
+        return;
+
+    /* A packet NACKed exactly once times the NACK -> resend round trip, which
+     * paces repeated NACKs. */
+    if (gap->second.nacks == 1)
+        rtt.add_sample(
+            duration_cast<microseconds>(now - gap->second.nacked_at).count());
+    gaps.erase(gap);
+}
+
+void FileTransmitter::send_nacks()
+{
+    if (!nack_enabled)
+        return;
+
+    using namespace std::chrono;
+    auto now = high_resolution_clock::now();
+
+    std::vector<uint32_t> ids;
+    for (auto &[id, gap] : gaps) {
+        auto missing_for = duration_cast<microseconds>(now - gap.seen_at);
+        auto since_nack = duration_cast<microseconds>(now - gap.nacked_at);
+
+        /* Leave reordered packets some time, then NACK again once per RTO
+         * until the resend arrives. */
+        if (missing_for.count() < NACK_REORDER_DELAY ||
+            (gap.nacks > 0 && since_nack.count() < rtt.rto()))
             continue;
 
-        recvd_fs_msgs[ev.msg_id] = ev.msg_id;
-
-        /* Remove data from message so we don't store it pointlessly... */
-        recvd_msgs[ev.msg_id].content = std::vector<std::byte>{0};
-
-        /* If correct packet received, add it to file. */
-        /* If wrong packet received, stash it and sort the stash. */
-        /* Once correct packet received, add it and as many stashed packets as
-         * possible. */
-
-        if (recvd_fs_msgs.size() % 10 == 0)
-            std::cout << "Progress: "
-                      << recvd_fs_msgs.size() / (float)f_pckt_n * 100.0f
-                      << "%\r" << std::flush;
-
-        if (ev.msg_id == next_packet_id_to_write) {
-            auto &c = ev.content;
-            file_o.write((char *)&c[0], c.size());
-            ev.content = std::vector<std::byte>{};
-            ++next_packet_id_to_write;
-
-            if (packet_shelf.size() > 0)
-                while (packet_shelf[0].msg_id == next_packet_id_to_write) {
-                    auto &c = packet_shelf[0].data;
-                    file_o.write((char *)&c[0], c.size());
-                    packet_shelf.erase(packet_shelf.begin());
-                    ++next_packet_id_to_write;
-                }
-        } else {
-            PacketShelfItem item{.data = ev.content, .msg_id = ev.msg_id};
-            packet_shelf.push_back(item);
-            ev.content = std::vector<std::byte>{};
-            std::sort(packet_shelf.begin(), packet_shelf.end(),
-                      [](const PacketShelfItem &a, const PacketShelfItem &b) {
-                          return a.msg_id < b.msg_id;
-                      });
+        gap.nacked_at = now;
+        if (gap.nacks < UINT8_MAX)
+            ++gap.nacks;
+        ids.push_back(static_cast<uint32_t>(id));
+    }
+
+    /* As many IDs per NACK as fit in a packet. */
+    const size_t per_nack = DATA_LEN / sizeof(uint32_t);
+    for (size_t i = 0; i < ids.size(); i += per_nack) {
+        size_t n = std::min(per_nack, ids.size() - i);
+        std::vector<std::byte> content(n * sizeof(uint32_t));
+        memcpy(&content[0], &ids[i], content.size());
+
+        OutEvent e{content, static_cast<uint32_t>(n), src_ip,
+                   OutEventType::O_NACK, session.id};
+        out_queue.push(e);
+    }
+}
+
+void FileTransmitter::skip_late_packets()
+{
+    if (msg_deadline == 0)
+        return;
+
+    using namespace std::chrono;
+    auto now = high_resolution_clock::now();
+
+    /* The sender gave up on these by now: count them as received, leave
+     * zeros in the file and move the write point past them. A late arrival
+     * is then dropped as a duplicate. */
+    bool any = false;
+    for (auto gap = gaps.begin(); gap != gaps.end();) {
+        auto missing_for =
+            duration_cast<microseconds>(now - gap->second.seen_at);
+        if (missing_for.count() < msg_deadline) {
+            ++gap;
+            continue;
         }
+
+        stored_ids.insert(gap->first);
+        recvd_ids.insert(gap->first);
+        ++skipped;
+        any = true;
+        gap = gaps.erase(gap);
     }
+
+    if (!any)
+        return;
+
+    advance_write_point(nullptr);
+    check_completion();
 }
 
-bool FileTransmitter::receive_checksum_confirmation_msg()
+void FileTransmitter::update_flow_window()
 {
-    const auto &content = recvd_msgs[0].content;
-    if (content.size() < 16)
-        throw std::runtime_error(CHKSUM_MSG_INV);
+    using namespace std::chrono;
+    auto now = high_resolution_clock::now();
+
+    /* Buffer space past the write point, less what is still queued for
+     * this thread. Out of order packets can only land within it. */
+    size_t backlog =
+        std::min<size_t>(session.main_queue.size(), flow_window / 2);
+    uint64_t limit = next_packet_id_to_write + flow_window - backlog;
+    session.recv_limit = limit;
 
-    /* Extract and validate the checksum confirmation text */
-    std::string h_text(reinterpret_cast<const char *>(content.data()) + 3, 6);
-    if (h_text != "CHKSUM")
-        throw std::runtime_error(CHKSUM_DATA_INV);
+    /* Multicast goes at a fixed rate, nobody to tell. */
+    if (session.multicast)
+        return;
+
+    /* ACKs are sent before their packet is processed, so the one that
+     * would open a full window may never come. Send the window in a
+     * duplicate ACK of the last written packet when it opened up a lot, or
+     * now and then when it changed at all. */
+    if (limit == advertised_limit || next_packet_id_to_write <= min_msg_id)
+        return;
+    auto since = duration_cast<microseconds>(now - advertised_at).count();
+    if (limit < advertised_limit + flow_window / 4 &&
+        since < FLOW_UPDATE_DELAY)
+        return;
+
+    advertised_limit = limit;
+    advertised_at = now;
+    OutEvent ack{make_ack(ACK_OK, session.recv_limit),
+                 next_packet_id_to_write - 1, src_ip, OutEventType::O_ACK,
+                 session.id};
+    out_queue.push(ack);
+}
 
-    return (char)(content[12]) == '1';
+bool FileTransmitter::receive_checksum_confirmation_msg()
+{
+    return verdict_match;
 }
 
+bool FileTransmitter::partial_verdict() { return verdict_partial; }
+
 bool FileTransmitter::did_receive_checksum_confirmation()
 {
-    return recvd_msgs.size() == 1;
+    return got_verdict;
 }
 
+void FileTransmitter::set_ack(MainEvent ev)
+{
+    /* The receiver ACKs the checksum message once on arrival and again with
+     * its verdict after checking the file. */
+    if (mode == TransmitterMode::SEND && ev.msg_id == f_pckt_n &&
+        ev.content.size() >= ACK_LEN &&
+        (ev.content[0] == std::byte{ACK_VERIFIED} ||
+         ev.content[0] == std::byte{ACK_MISMATCH} ||
+         ev.content[0] == std::byte{ACK_PARTIAL})) {
+        got_verdict = true;
+        verdict_match = ev.content[0] == std::byte{ACK_VERIFIED};
+        verdict_partial = ev.content[0] == std::byte{ACK_PARTIAL};
+    }
+
+    Transmitter::set_ack(ev);
+}
+
+void FileTransmitter::check_completion()
+{
+    /* A verdict means all data arrived, and the reply may never come. */
+    if (mode == TransmitterMode::SEND)
+        this->done = got_verdict;
+    else
+        Transmitter::check_completion();
+}
+
+void FileTransmitter::probe_verdict()
+{
+    using namespace std::chrono;
+
+    /* Resends take care of the checksum message until it is ACKed. */
+    SentMessage *msg = sent_msgs.find(f_pckt_n);
+    if (got_verdict || (msg && !msg->ackd))
+        return;
+
+    /* The verdict ACK got lost, or the receiver is still at it. Ask again
+     * with a copy of the checksum message, backing off. */
+    auto now = high_resolution_clock::now();
+    auto wait = rtt.rto() << std::min<uint32_t>(verdict_probes, 6);
+    if (duration_cast<microseconds>(now - probe_at).count() < wait)
+        return;
+
+    if (++verdict_probes > VERDICT_PROBES)
+        throw std::runtime_error("No checksum verdict from the receiver.");
+    probe_at = now;
+    OutEvent e{checksum_content, f_pckt_n, dest_ip, OutEventType::O_MSG,
+               session.id};
+    out_queue.push(e, OutLane::L_CONTROL);
+}
+
+std::string FileTransmitter::file_sha() { return sha.getHash(); }
+
+uint64_t FileTransmitter::skipped_packets() { return skipped; }
+
 std::string FileTransmitter::receive_checksum_msg()
 {
-    /* recvd_msgs is indexed by message ID, where message with
-    ID=0 is not in the map because that's the header and that is received
-    by a different transmitter. */
-    const auto &content = recvd_msgs[recvd_msgs.size()].content;
+    /* The checksum follows the data packets, which aren't kept. */
+    const auto &content = recvd_msgs[f_pckt_n];
     std::string md5;
     md5.reserve(content.size());
     for (const auto &byte : content)
@@ -197,4 +582,10 @@ std::string FileTransmitter::receive_checksum_msg()
     return md5;
 }
 
-void FileTransmitter::close_write_file() { this->file_o.close(); }
\ No newline at end of file
+void FileTransmitter::close_write_file()
+{
+    if (file_fd >= 0) {
+        close(file_fd);
+        file_fd = -1;
+    }
+}
\ No newline at end of file
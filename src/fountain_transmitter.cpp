@@ -0,0 +1,165 @@
+#include "fountain_transmitter.h"
+#include "checksum_transmitter.h"
+#include <algorithm>
+
+/* Most symbols sent per main loop iteration, bounds bursts after stalls. */
+#define FOUNTAIN_MAX_BURST 64
+
+static uint32_t block_count(size_t f_size, size_t symbol_len)
+{
+    /* Symbols are numbered by the 32-bit wire IDs, and the decoder keeps
+     * all blocks in memory anyway. Larger files go in stream mode. */
+    size_t blocks = (f_size + symbol_len - 1) / symbol_len;
+    if (blocks > UINT32_MAX)
+        throw std::runtime_error("File too large for fountain mode :(");
+
+    return std::max<uint32_t>(1, static_cast<uint32_t>(blocks));
+}
+
+FountainTransmitter::FountainTransmitter(
+    std::string &dest_ip, size_t out_msg_count, size_t in_msg_count,
+    Session &session, OutQueue &out_queue,
+    uint64_t min_ack_id, uint64_t min_msg_id, size_t f_size, size_t symbol_len)
+    : Transmitter{dest_ip,   out_msg_count, in_msg_count, session,
+                  out_queue, min_ack_id,    min_msg_id},
+      f_size{f_size}, symbol_len{symbol_len},
+      code{block_count(f_size, symbol_len)}
+{
+}
+
+FountainTransmitter::FountainTransmitter(size_t in_msg_count,
+                                         Session &session,
+                                         OutQueue &out_queue,
+                                         uint64_t min_ack_id,
+                                         uint64_t min_msg_id, size_t f_size,
+                                         size_t symbol_len)
+    : Transmitter{in_msg_count, session, out_queue, min_ack_id, min_msg_id},
+      f_size{f_size}, symbol_len{symbol_len},
+      code{block_count(f_size, symbol_len)}
+{
+    decoder = std::make_unique<LtDecoder>(code.k, symbol_len);
+}
+
+void FountainTransmitter::start_stream_symbols(const std::string &filename,
+                                               std::string &sha)
+{
+    file = std::ifstream{filename, std::ios::binary};
+    if (!file.is_open())
+        throw std::runtime_error("Couldn't open file :( " + filename);
+
+    /* The SHA goes out reliably, the receiver needs it to verify. */
+    std::vector<std::byte> data;
+    data.reserve(sha.size());
+    for (char c : sha)
+        data.push_back(std::byte{static_cast<unsigned char>(c)});
+    send_msg(data);
+
+    /* Symbols are paced by the clock, not by ACKs. */
+    session.tick_delay = MIN_TICK;
+    credit_at = std::chrono::high_resolution_clock::now();
+}
+
+void FountainTransmitter::continue_stream_symbols()
+{
+    using namespace std::chrono;
+
+    /* The checksum confirmation implies the SHA arrived, even if its ACK
+     * didn't. */
+    if (recvd_ids.size() == 1) {
+        this->done = true;
+        return;
+    }
+
+    auto now = high_resolution_clock::now();
+    auto elapsed = duration_cast<microseconds>(now - credit_at).count();
+    credit_at = now;
+
+    /* FOUNTAIN_RATE kB/s in symbol_len sized symbols. */
+    credit += elapsed * (FOUNTAIN_RATE * 1000.0 / symbol_len) / 1e6;
+    credit = std::min<double>(credit, FOUNTAIN_MAX_BURST);
+
+    /* A capped share of the link drains slower than FOUNTAIN_RATE. */
+    while (credit >= 1.0 && !done &&
+           out_queue.queued(session.id) < OUT_BACKLOG) {
+        send_symbol();
+        credit -= 1.0;
+    }
+}
+
+void FountainTransmitter::send_symbol()
+{
+    std::vector<uint32_t> blocks;
+    code.neighbours(next_symbol, blocks);
+
+    std::vector<std::byte> symbol(symbol_len, std::byte{0});
+    std::vector<std::byte> buffer(symbol_len);
+    for (uint32_t b : blocks) {
+        /* The last block is shorter, the rest of it counts as zeros. */
+        std::fill(buffer.begin(), buffer.end(), std::byte{0});
+        file.clear();
+        file.seekg(static_cast<std::streamoff>(b) * symbol_len);
+        file.read(reinterpret_cast<char *>(buffer.data()), symbol_len);
+        for (size_t i = 0; i < symbol_len; ++i)
+            symbol[i] ^= buffer[i];
+    }
+
+    OutEvent e{symbol, next_symbol++, dest_ip, OutEventType::O_SYM, session.id};
+    out_queue.push(e);
+}
+
+bool FountainTransmitter::receive_checksum_confirmation_msg()
+{
+    return parse_checksum_confirmation_msg(recvd_msgs[min_msg_id]);
+}
+
+void FountainTransmitter::receive_symbols(std::vector<MainEvent> evs)
+{
+    uint32_t before = decoder->decoded_count();
+
+    for (const MainEvent &ev : evs) {
+        if (ev.type == MainEventType::M_SYM)
+            decoder->add_symbol(ev.msg_id, ev.content);
+    }
+
+    if (decoder->decoded_count() / 64 != before / 64)
+        std::cout << "Progress: "
+                  << decoder->decoded_count() / (float)code.k * 100.0f
+                  << "%\r" << std::flush;
+
+    check_completion();
+}
+
+void FountainTransmitter::write_file(const std::string &f_name)
+{
+    std::ofstream file_o{f_name, std::ios::binary | std::ios::out};
+    if (!file_o.is_open())
+        throw std::runtime_error("Couldn't open file for writing :( ");
+
+    size_t left = f_size;
+    for (uint32_t b = 0; b < code.k && left > 0; ++b) {
+        const auto &block = decoder->block(b);
+        size_t len = std::min<size_t>(left, symbol_len);
+        file_o.write(reinterpret_cast<const char *>(block.data()), len);
+        left -= len;
+    }
+}
+
+std::string FountainTransmitter::receive_checksum_msg()
+{
+    const auto &content = recvd_msgs[min_msg_id];
+    std::string sha;
+    sha.reserve(content.size());
+    for (const auto &byte : content)
+        sha.push_back(static_cast<char>(byte));
+
+    return sha;
+}
+
+void FountainTransmitter::check_completion()
+{
+    Transmitter::check_completion();
+
+    /* The receiver is done once it also decoded the whole file. */
+    if (decoder)
+        this->done = this->done && decoder->done();
+}
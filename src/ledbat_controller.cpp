@@ -0,0 +1,146 @@
+#include "ledbat_controller.h"
+#include <algorithm>
+
+/* RFC 6817 parameters; delays in microseconds, window in messages. The
+ * target is far below the RFC's 100 ms ceiling, flows on a LAN rarely
+ * queue more than a few milliseconds and would never push us back. */
+#define LEDBAT_TARGET 5000         /* Queuing delay the window aims for. */
+#define LEDBAT_GAIN 1.0            /* Window change per RTT at 0 delay. */
+#define LEDBAT_ALLOWED_INCREASE 1  /* Window growth past what's in flight. */
+#define LEDBAT_BASE_HISTORY 10     /* Minutes the base delay is kept for. */
+#define LEDBAT_CURRENT_FILTER 4    /* Samples in the current delay. */
+#define LEDBAT_SLOWDOWN_RTTS 2     /* How long a slowdown holds the window. */
+#define LEDBAT_SLOWDOWN_GAP 9      /* Gap between slowdowns, per length. */
+
+/* a < b modulo 2^32. */
+static bool earlier(uint32_t a, uint32_t b)
+{
+    return static_cast<int32_t>(a - b) < 0;
+}
+
+LedbatController::LedbatController()
+{
+    cwnd = INITIAL_CWND;
+    ssthresh = MAX_CWND;
+}
+
+void LedbatController::on_ack(const AckSample &sample)
+{
+    using namespace std::chrono;
+
+    /* Resent messages give no delay sample to steer by. */
+    if (sample.rtt_us < 0)
+        return;
+
+    update_base_delay(sample.one_way_us, sample.now);
+    current_delays.push_back(sample.one_way_us);
+    if (current_delays.size() > LEDBAT_CURRENT_FILTER)
+        current_delays.pop_front();
+
+    int64_t queuing = queuing_delay();
+    microseconds srtt{sample.srtt_us};
+
+    if (in_slowdown) {
+        if (sample.now < slowdown_end)
+            return;
+        in_slowdown = false;
+        slow_start = true;
+    }
+
+    /* Leave slow start with a quarter of the target to spare, like
+     * LEDBAT++, rather than overshooting it by a whole window. */
+    if (slow_start) {
+        if (queuing < LEDBAT_TARGET * 3 / 4 && cwnd < ssthresh) {
+            cwnd = std::min<double>(cwnd + 1.0, MAX_CWND);
+            return;
+        }
+        slow_start = false;
+
+        /* The first slowdown soon after the initial slow start, the next
+         * ones spaced so they take about a tenth of the time. */
+        if (slowed_down)
+            slowdown_at = sample.now + LEDBAT_SLOWDOWN_GAP *
+                                           (sample.now - slowdown_start);
+        else
+            slowdown_at = sample.now + LEDBAT_SLOWDOWN_RTTS * srtt;
+    }
+
+    if (sample.now >= slowdown_at) {
+        ssthresh = cwnd;
+        cwnd = MIN_CWND;
+        in_slowdown = true;
+        slowed_down = true;
+        slowdown_start = sample.now;
+        slowdown_end = sample.now + LEDBAT_SLOWDOWN_RTTS * srtt;
+        return;
+    }
+
+    /* Linear controller: grows below the target, shrinks above it, in
+     * proportion to the distance. */
+    double off_target =
+        (LEDBAT_TARGET - queuing) / static_cast<double>(LEDBAT_TARGET);
+    double next = cwnd + LEDBAT_GAIN * off_target / cwnd;
+
+    /* An application limited sender doesn't learn anything about the path
+     * by growing a window it doesn't use. */
+    if (next > cwnd)
+        next = std::min<double>(
+            next, std::max<double>(cwnd, sample.in_flight + 1 +
+                                             LEDBAT_ALLOWED_INCREASE));
+
+    cwnd = std::clamp<double>(next, MIN_CWND, MAX_CWND);
+}
+
+void LedbatController::on_loss(time_p sent_at, time_p now)
+{
+    if (sent_at <= recovery_start)
+        return;
+
+    cwnd = std::max<double>(cwnd / 2.0, MIN_CWND);
+    ssthresh = cwnd;
+    recovery_start = now;
+}
+
+void LedbatController::on_timeout(time_p now)
+{
+    ssthresh = std::max<double>(cwnd / 2.0, MIN_CWND);
+    cwnd = MIN_CWND;
+    slow_start = true;
+    recovery_start = now;
+}
+
+uint32_t LedbatController::window() const
+{
+    return static_cast<uint32_t>(std::max<double>(cwnd, MIN_CWND));
+}
+
+void LedbatController::update_base_delay(uint32_t delay, time_p now)
+{
+    using namespace std::chrono;
+
+    /* One minimum per minute, so a route change that raises the delay for
+     * good is picked up after LEDBAT_BASE_HISTORY minutes. */
+    if (base_delays.empty() || now - base_rolled_at >= minutes(1)) {
+        base_delays.push_back(delay);
+        base_rolled_at = now;
+        if (base_delays.size() > LEDBAT_BASE_HISTORY)
+            base_delays.pop_front();
+    } else if (earlier(delay, base_delays.back())) {
+        base_delays.back() = delay;
+    }
+}
+
+int64_t LedbatController::queuing_delay() const
+{
+    uint32_t base = base_delays.front();
+    for (uint32_t d : base_delays)
+        if (earlier(d, base))
+            base = d;
+
+    uint32_t current = current_delays.front();
+    for (uint32_t d : current_delays)
+        if (earlier(d, current))
+            current = d;
+
+    return static_cast<int32_t>(current - base);
+}
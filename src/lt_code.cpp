@@ -0,0 +1,160 @@
+#include "lt_code.h"
+#include <algorithm>
+#include <cmath>
+
+/* Robust soliton parameters: spike position constant and failure bound. */
+#define LT_C 0.03
+#define LT_DELTA 0.5
+
+/**
+ * @brief splitmix64, a tiny PRNG whose output only depends on its seed, so
+ * both ends draw the same numbers.
+ */
+static uint64_t next_random(uint64_t &state)
+{
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static double next_uniform(uint64_t &state)
+{
+    return (next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+LtCode::LtCode(uint32_t k) : k{k}
+{
+    /* Robust soliton: ideal soliton rho plus the spike tau. */
+    double r = LT_C * std::log(k / LT_DELTA) * std::sqrt(k);
+    uint32_t spike = std::clamp<uint32_t>(
+        static_cast<uint32_t>(std::round(k / std::max(r, 1.0))), 1, k);
+
+    std::vector<double> mu(k);
+    double sum = 0.0;
+    for (uint32_t d = 1; d <= k; ++d) {
+        double rho = d == 1 ? 1.0 / k : 1.0 / (d * (d - 1.0));
+        double tau = 0.0;
+        if (d < spike)
+            tau = r / (d * (double)k);
+        else if (d == spike)
+            tau = r * std::log(r / LT_DELTA) / k;
+        mu[d - 1] = rho + std::max(tau, 0.0);
+        sum += mu[d - 1];
+    }
+
+    cdf.resize(k);
+    double acc = 0.0;
+    for (uint32_t d = 0; d < k; ++d) {
+        acc += mu[d] / sum;
+        cdf[d] = acc;
+    }
+    cdf[k - 1] = 1.0;
+}
+
+void LtCode::neighbours(uint32_t symbol_id, std::vector<uint32_t> &blocks) const
+{
+    blocks.clear();
+
+    uint64_t state = (static_cast<uint64_t>(k) << 32) | symbol_id;
+    double u = next_uniform(state);
+    uint32_t degree =
+        std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin() + 1;
+
+    /* Degrees are small next to K, so rejection of repeats is cheap. */
+    while (blocks.size() < degree) {
+        uint32_t b = static_cast<uint32_t>(next_random(state) % k);
+        if (std::find(blocks.begin(), blocks.end(), b) == blocks.end())
+            blocks.push_back(b);
+    }
+}
+
+LtDecoder::LtDecoder(uint32_t k, size_t symbol_len)
+    : code{k}, symbol_len{symbol_len}
+{
+    blocks.resize(k);
+    known.resize(k, false);
+    block_symbols.resize(k);
+}
+
+void LtDecoder::add_symbol(uint32_t symbol_id,
+                           const std::vector<std::byte> &data)
+{
+    if (done() || data.size() != symbol_len)
+        return;
+
+    PendingSymbol sym{.blocks{}, .data = data};
+    code.neighbours(symbol_id, sym.blocks);
+
+    /* XOR out what's already decoded. */
+    auto it = sym.blocks.begin();
+    while (it != sym.blocks.end()) {
+        if (known[*it]) {
+            const auto &b = blocks[*it];
+            for (size_t i = 0; i < symbol_len; ++i)
+                sym.data[i] ^= b[i];
+            it = sym.blocks.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    if (sym.blocks.empty())
+        return;
+
+    if (sym.blocks.size() == 1) {
+        release(sym.blocks[0], std::move(sym.data));
+        return;
+    }
+
+    const uint32_t idx = static_cast<uint32_t>(pending.size());
+    for (uint32_t b : sym.blocks)
+        block_symbols[b].push_back(idx);
+    pending.push_back(std::move(sym));
+}
+
+void LtDecoder::release(uint32_t idx, std::vector<std::byte> data)
+{
+    std::vector<std::pair<uint32_t, std::vector<std::byte>>> ripple;
+    ripple.emplace_back(idx, std::move(data));
+
+    while (!ripple.empty()) {
+        auto [b, content] = std::move(ripple.back());
+        ripple.pop_back();
+        if (known[b])
+            continue;
+
+        blocks[b] = std::move(content);
+        known[b] = true;
+        ++known_count;
+
+        /* Peel the block off every symbol it takes part in. */
+        for (uint32_t s : block_symbols[b]) {
+            auto &sym = pending[s];
+            auto pos = std::find(sym.blocks.begin(), sym.blocks.end(), b);
+            if (pos == sym.blocks.end())
+                continue;
+
+            sym.blocks.erase(pos);
+            for (size_t i = 0; i < symbol_len; ++i)
+                sym.data[i] ^= blocks[b][i];
+
+            if (sym.blocks.size() == 1 && !known[sym.blocks[0]])
+                ripple.emplace_back(sym.blocks[0], std::move(sym.data));
+            if (sym.blocks.size() <= 1) {
+                sym.blocks.clear();
+                sym.data = std::vector<std::byte>{};
+            }
+        }
+        block_symbols[b] = std::vector<uint32_t>{};
+    }
+}
+
+bool LtDecoder::done() const { return known_count == code.k; }
+
+const std::vector<std::byte> &LtDecoder::block(uint32_t idx) const
+{
+    return blocks[idx];
+}
+
+uint32_t LtDecoder::decoded_count() const { return known_count; }
@@ -0,0 +1,269 @@
+#include "multicast_transmitter.h"
+#include <algorithm>
+
+/* Header (and later checksum) repeat period, how long the join phase goes on
+ * after the first announcement and how long receivers may take to join, or
+ * stay quiet once the checksum is out. [us] */
+#define MCAST_ANNOUNCE_DELAY 100000
+#define MCAST_JOIN_DELAY 500000
+#define MCAST_MEMBER_TIMEOUT 5000000
+
+MulticastTransmitter::MulticastTransmitter(std::string &group_ip,
+                                           Session &session,
+                                           OutQueue &out_queue,
+                                           uint64_t f_pckt_n)
+    : Transmitter{group_ip, 0, 1, session, out_queue, 0, 0}
+{
+    this->f_pckt_n = f_pckt_n;
+}
+
+void MulticastTransmitter::start_multicast(const SessionParams &offer,
+                                           ChunkCache &cache,
+                                           uint32_t receivers)
+{
+    this->cache = &cache;
+    chunk_len = offer.chunk_len;
+    fec_enabled = offer.options & SESSION_OPT_FEC;
+    expected = receivers;
+    header_content = encode_session(offer);
+
+    /* Data starts behind the header, and goes out by the clock. */
+    session.next_id = 1;
+    session.tick_delay = MIN_TICK;
+    announce();
+    started_at = announced_at;
+}
+
+void MulticastTransmitter::continue_multicast(
+    const std::vector<MainEvent> &evs)
+{
+    using namespace std::chrono;
+    auto now = high_resolution_clock::now();
+
+    for (const MainEvent &ev : evs)
+        handle_event(ev);
+
+    if (now - announced_at >= microseconds(MCAST_ANNOUNCE_DELAY))
+        announce();
+
+    /* Everyone expected is in, or whoever was going to join has, counted
+     * from the first announcement. Late receivers NACK what they missed. */
+    if (joining) {
+        auto waited = now - started_at;
+        if (members.empty() && waited >= microseconds(MCAST_MEMBER_TIMEOUT))
+            throw std::runtime_error("No receiver joined the group.");
+
+        joining = members.empty() ||
+                  (expected > 0 ? members.size() < expected &&
+                                      waited < microseconds(MCAST_MEMBER_TIMEOUT)
+                                : waited < microseconds(MCAST_JOIN_DELAY));
+    }
+
+    if (!joining) {
+        send_repairs();
+        send_data();
+    }
+
+    check_members();
+}
+
+const std::map<uint32_t, McastMember> &MulticastTransmitter::receivers() const
+{
+    return members;
+}
+
+void MulticastTransmitter::check_completion()
+{
+    /* Nothing is ACKed, check_members() decides. */
+}
+
+void MulticastTransmitter::handle_event(const MainEvent &ev)
+{
+    using namespace std::chrono;
+    auto now = high_resolution_clock::now();
+
+    if (ev.type != MainEventType::M_MSG && ev.type != MainEventType::M_ACK &&
+        ev.type != MainEventType::M_NACK)
+        return;
+
+    bool joined = members.count(ev.session) == 0;
+    McastMember &m = member(ev);
+
+    if (ev.type == MainEventType::M_MSG && ev.msg_id == 0 && joined) {
+        /* The header reply. Data is out in the offered chunk length. */
+        if (decode_session(ev.content).chunk_len != chunk_len) {
+            std::cout << "Receiver " << m.ip
+                      << " refused the chunk length, left out." << std::endl;
+            m.given_up = true;
+            return;
+        }
+
+        /* Most likely the answer to the latest announcement. */
+        auto since = duration_cast<microseconds>(now - announced_at).count();
+        if (since < MCAST_ANNOUNCE_DELAY)
+            rtt.add_sample(since);
+
+        std::cout << "Receiver " << m.ip << " joined (" << members.size()
+                  << (expected > 0 ? "/" + std::to_string(expected) : "")
+                  << ")." << std::endl;
+    } else if (ev.type == MainEventType::M_NACK) {
+        const size_t n = ev.content.size() / sizeof(uint32_t);
+        for (size_t i = 0; i < n; ++i) {
+            uint32_t wire_id = 0;
+            memcpy(&wire_id, &ev.content[i * sizeof(uint32_t)],
+                   sizeof(wire_id));
+            uint64_t id = expand_id(wire_id, session.next_id);
+            if (id == 0 || id >= f_pckt_n || id >= session.next_id)
+                continue;
+
+            /* A packet counts as lost once, however many receivers miss
+             * it: that is the loss the parity has to cover. */
+            if (repairs.insert(id).second && repaired_at.count(id) == 0)
+                update_loss_rate(true);
+        }
+    } else if (ev.type == MainEventType::M_ACK && ev.msg_id == f_pckt_n &&
+               ev.content.size() >= ACK_LEN &&
+               (ev.content[0] == std::byte{ACK_VERIFIED} ||
+                ev.content[0] == std::byte{ACK_MISMATCH})) {
+        m.got_verdict = true;
+        m.match = ev.content[0] == std::byte{ACK_VERIFIED};
+    }
+}
+
+McastMember &MulticastTransmitter::member(const MainEvent &ev)
+{
+    auto now = std::chrono::high_resolution_clock::now();
+    auto it = members.find(ev.session);
+    if (it == members.end()) {
+        it = members
+                 .emplace(ev.session, McastMember{.ip = ev.origin_ip,
+                                                  .heard_at = now,
+                                                  .got_verdict = false,
+                                                  .match = false,
+                                                  .given_up = false})
+                 .first;
+    }
+
+    it->second.heard_at = now;
+    return it->second;
+}
+
+void MulticastTransmitter::announce()
+{
+    announced_at = std::chrono::high_resolution_clock::now();
+
+    /* The header for whoever hasn't joined yet, then the checksum for whoever
+     * hasn't given a verdict. */
+    if (!sent_checksum) {
+        OutEvent e{header_content, 0, dest_ip, OutEventType::O_MSG,
+                   session.id};
+        out_queue.push(e, OutLane::L_CONTROL);
+        return;
+    }
+
+    for (auto &[id, m] : members) {
+        if (!m.got_verdict && !m.given_up) {
+            OutEvent e{checksum_content, f_pckt_n, dest_ip,
+                       OutEventType::O_MSG, session.id};
+            out_queue.push(e, OutLane::L_CONTROL);
+            return;
+        }
+    }
+}
+
+void MulticastTransmitter::send_repairs()
+{
+    using namespace std::chrono;
+    auto now = high_resolution_clock::now();
+
+    /* NACKs of a packet that crossed its repair on the way, from this
+     * receiver or another one, are suppressed. */
+    auto holdoff = microseconds(std::max<int64_t>(rtt.srtt(), MIN_TICK));
+
+    while (!repairs.empty() && out_queue.queued(session.id) < OUT_BACKLOG) {
+        uint64_t id = *repairs.begin();
+        repairs.erase(repairs.begin());
+
+        auto last = repaired_at.find(id);
+        if (last != repaired_at.end() && now - last->second < holdoff)
+            continue;
+
+        Chunk data = cache->again(id - 1);
+        OutEvent e{{}, id, dest_ip, OutEventType::O_MSG, session.id, data};
+        out_queue.push(e, OutLane::L_RESEND);
+        repaired_at[id] = now;
+        ++repair_count;
+    }
+}
+
+void MulticastTransmitter::send_data()
+{
+    /* The session's rate cap drains the queue, keep it just full. */
+    while (!sent_checksum && out_queue.queued(session.id) < OUT_BACKLOG) {
+        const uint64_t id = session.next_id;
+        if (id < f_pckt_n) {
+            Chunk data = cache->take(0, id - 1);
+            OutEvent e{{}, id, dest_ip, OutEventType::O_MSG, session.id, data};
+            out_queue.push(e);
+            session.next_id = id + 1;
+            update_loss_rate(false);
+
+            std::vector<FecParity> parities;
+            fec.add(id, *data,
+                    fec_enabled ? FecEncoder::block_len(loss_rate) : 0,
+                    parities);
+            for (const FecParity &parity : parities)
+                send_parity(parity);
+            continue;
+        }
+
+        /* Protect the tail too, then the checksum right behind it. Taking
+         * the last chunk hashed the file. */
+        FecParity tail;
+        if (fec.close(tail))
+            send_parity(tail);
+        for (char c : cache->sha())
+            checksum_content.push_back(
+                std::byte{static_cast<unsigned char>(c)});
+        OutEvent e{checksum_content, f_pckt_n, dest_ip, OutEventType::O_MSG,
+                   session.id};
+        out_queue.push(e);
+        session.next_id = f_pckt_n + 1;
+        sent_checksum = true;
+        checksum_at = std::chrono::high_resolution_clock::now();
+        announced_at = checksum_at;
+    }
+}
+
+void MulticastTransmitter::send_parity(const FecParity &parity)
+{
+    OutEvent e{parity.content, parity.first, dest_ip, OutEventType::O_FEC,
+               session.id};
+    out_queue.push(e);
+}
+
+void MulticastTransmitter::check_members()
+{
+    using namespace std::chrono;
+    auto now = high_resolution_clock::now();
+
+    if (!sent_checksum || members.empty())
+        return;
+
+    bool all = true;
+    for (auto &[id, m] : members) {
+        if (m.got_verdict || m.given_up)
+            continue;
+
+        auto quiet = now - std::max(m.heard_at, checksum_at);
+        if (quiet > microseconds(MCAST_MEMBER_TIMEOUT)) {
+            std::cout << "Receiver " << m.ip << " went quiet, given up on."
+                      << std::endl;
+            m.given_up = true;
+            continue;
+        }
+        all = false;
+    }
+
+    this->done = all;
+}
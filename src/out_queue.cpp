@@ -0,0 +1,169 @@
+#include "out_queue.h"
+#include <algorithm>
+
+/* Bytes an event takes on the wire, near enough for scheduling. */
+static size_t event_len(const OutEvent &ev)
+{
+    return FRAME_HEADER_LEN + event_content(ev).size();
+}
+
+OutQueue::OutQueue() {}
+
+void OutQueue::push(const OutEvent &item)
+{
+    bool control = item.type == OutEventType::O_ACK ||
+                   item.type == OutEventType::O_NACK ||
+                   item.type == OutEventType::O_RANGE;
+    push(item, control ? OutLane::L_CONTROL : OutLane::L_DATA);
+}
+
+void OutQueue::push(const OutEvent &item, OutLane lane)
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (lane == OutLane::L_CONTROL) {
+            control.push(item);
+        } else {
+            auto it = flows.find(item.session);
+            if (it == flows.end()) {
+                it = flows.emplace(item.session, Flow{.resends{}, .data{},
+                                                      .deficit = 0})
+                         .first;
+                active.push_back(item.session);
+            }
+            if (lane == OutLane::L_RESEND)
+                it->second.resends.push(item);
+            else
+                it->second.data.push(item);
+        }
+        ++count;
+    }
+    cond.notify_one();
+}
+
+std::vector<OutEvent> OutQueue::wait_nonempty(size_t max)
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    std::vector<OutEvent> list;
+    while (true) {
+        time_p ready_at = time_p::max();
+        take(max, std::chrono::high_resolution_clock::now(), list, ready_at);
+        if (!list.empty() || stop)
+            return list;
+
+        /* Nothing queued, or all of it waiting for tokens. */
+        if (ready_at == time_p::max())
+            cond.wait(lock);
+        else
+            cond.wait_until(lock, ready_at);
+    }
+}
+
+void OutQueue::take(size_t max, time_p now, std::vector<OutEvent> &list,
+                    time_p &ready_at)
+{
+    while (!control.empty() && list.size() < max) {
+        global.has_room(now);
+        global.take(event_len(control.front()));
+        list.push_back(control.front());
+        control.pop();
+        --count;
+    }
+
+    /* Stop once every active session was passed over in a row. */
+    size_t skipped = 0;
+    while (!active.empty() && list.size() < max && skipped < active.size()) {
+        if (!stop && !global.has_room(now)) {
+            ready_at = std::min(ready_at, global.ready_at());
+            return;
+        }
+
+        const uint32_t id = active.front();
+        Flow &flow = flows[id];
+        auto share = shares.find(id);
+        TokenBucket *cap = share == shares.end() ? nullptr
+                                                 : &share->second.bucket;
+        if (!stop && cap && !cap->has_room(now)) {
+            ready_at = std::min(ready_at, cap->ready_at());
+            active.push_back(id);
+            active.pop_front();
+            ++skipped;
+            continue;
+        }
+
+        /* A new turn: this session's weight in bytes. */
+        if (flow.deficit <= 0) {
+            uint32_t weight = share == shares.end() ? 1 : share->second.weight;
+            flow.deficit += static_cast<int64_t>(weight) * DRR_QUANTUM;
+        }
+
+        auto &lane = flow.resends.empty() ? flow.data : flow.resends;
+        const size_t len = event_len(lane.front());
+        flow.deficit -= len;
+        global.take(len);
+        if (cap)
+            cap->take(len);
+        list.push_back(lane.front());
+        lane.pop();
+        --count;
+        skipped = 0;
+
+        if (flow.resends.empty() && flow.data.empty()) {
+            flows.erase(id);
+            active.pop_front();
+        } else if (flow.deficit <= 0) {
+            active.push_back(id);
+            active.pop_front();
+        }
+    }
+}
+
+bool OutQueue::empty()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return count == 0;
+}
+
+size_t OutQueue::queued(uint32_t session)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = flows.find(session);
+    if (it == flows.end())
+        return 0;
+
+    return it->second.resends.size() + it->second.data.size();
+}
+
+void OutQueue::set_share(uint32_t session, uint32_t weight, double rate)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = shares.find(session);
+    if (it == shares.end())
+        it = shares.emplace(session, Share{.weight = 1, .bucket{0.0}}).first;
+    it->second.weight = std::max<uint32_t>(weight, 1);
+    it->second.bucket.set_rate(rate);
+}
+
+void OutQueue::forget_share(uint32_t session)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    shares.erase(session);
+}
+
+double OutQueue::rate_cap(uint32_t session)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    double cap = global.rate();
+    auto it = shares.find(session);
+    if (it != shares.end() && it->second.bucket.limited() &&
+        (cap <= 0.0 || it->second.bucket.rate() < cap))
+        cap = it->second.bucket.rate();
+
+    return cap;
+}
+
+void OutQueue::set_rate(double rate)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    global.set_rate(rate);
+}
@@ -0,0 +1,318 @@
+#include "range_schedule.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* Most chunks in one range request, and the fewest and most outstanding at
+ * a source. */
+#define RANGE_MAX_LEN 64
+#define RANGE_MIN_OUTSTANDING 32
+#define RANGE_MAX_OUTSTANDING 4096
+
+/* Time a source's outstanding chunks should keep it busy for besides the
+ * RTT, its delivery rate sample interval and the weight of a sample. */
+#define RANGE_PIPELINE_DELAY 50000 // [us]
+#define RANGE_RATE_INTERVAL 50000  // [us]
+#define RANGE_RATE_GAIN 0.25
+
+/* Longest a chunk may be outstanding, and a source go without delivering,
+ * before it counts as stalled, and before it is given up on. */
+#define RANGE_STALL_DELAY 500000 // [us]
+#define RANGE_QUIET_DELAY (10 * RANGE_STALL_DELAY)
+
+RangeSchedule::RangeSchedule(const std::string &f_name, uint32_t sources)
+    : f_name{f_name}, sources(sources, RangeSource{})
+{
+}
+
+RangeSchedule::~RangeSchedule()
+{
+    if (fd >= 0)
+        close(fd);
+}
+
+bool RangeSchedule::join(uint32_t source, const SessionParams &reply)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    if (reply.sha.empty())
+        return false;
+
+    if (!set_up) {
+        fd = open(f_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            throw std::runtime_error("Couldn't open file for writing :( ");
+        if (reply.f_size > 0 && posix_fallocate(fd, 0, reply.f_size) != 0 &&
+            ftruncate(fd, reply.f_size) != 0)
+            throw std::runtime_error("Couldn't size file for writing :( ");
+
+        f_size = reply.f_size;
+        chunk_len = reply.chunk_len;
+        count = (f_size + chunk_len - 1) / chunk_len;
+        file_sha = reply.sha;
+        set_up = true;
+        cond.notify_all();
+    } else if (reply.f_size != f_size || reply.chunk_len != chunk_len ||
+               reply.sha != file_sha) {
+        return false;
+    }
+
+    auto now = std::chrono::high_resolution_clock::now();
+    RangeSource &s = sources[source];
+    s.joined = true;
+    s.interval_at = now;
+    s.heard_at = now;
+    return true;
+}
+
+void RangeSchedule::leave(uint32_t source)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    drop(source);
+}
+
+void RangeSchedule::fail(const std::string &reason)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    error = reason;
+    cond.notify_all();
+}
+
+std::string RangeSchedule::failure()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return error;
+}
+
+void RangeSchedule::drop(uint32_t source)
+{
+    RangeSource &s = sources[source];
+    s.left = true;
+    s.joined = false;
+
+    for (auto it = requests.begin(); it != requests.end();) {
+        if (it->second.source == source) {
+            returned.insert(it->first);
+            it = requests.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    s.outstanding = 0;
+    cond.notify_all();
+}
+
+void RangeSchedule::deliver(uint32_t source, uint64_t index,
+                            const std::vector<std::byte> &data)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!set_up || index >= count || received.contains(index))
+        return;
+
+    /* Whoever it was asked from last doesn't owe it any more. */
+    RangeSource &s = sources[source];
+    auto req = requests.find(index);
+    if (req != requests.end()) {
+        RangeRequest &r = req->second;
+        --sources[r.source].outstanding;
+        if (r.source == source &&
+            (r.requested_at > s.rack_requested_at ||
+             (r.requested_at == s.rack_requested_at && index > s.rack_index))) {
+            s.rack_requested_at = r.requested_at;
+            s.rack_index = index;
+        }
+        requests.erase(req);
+    }
+    returned.erase(index);
+
+    /* Every chunk but the last is chunk_len long, at its own offset. */
+    off_t offset = static_cast<off_t>(index) * chunk_len;
+    size_t len = std::min<uint64_t>(chunk_len, f_size - offset);
+    if (data.size() != len)
+        throw std::runtime_error("Chunk of the wrong length :( ");
+    if (pwrite(fd, &data[0], len, offset) != static_cast<ssize_t>(len))
+        throw std::runtime_error("Couldn't write to file :( ");
+
+    received.insert(index);
+    ++s.delivered;
+    ++s.interval_delivered;
+    s.heard_at = std::chrono::high_resolution_clock::now();
+
+    if (received.size() % 100 == 0)
+        std::cout << "Progress: " << received.size() / (float)count * 100.0f
+                  << "%\r" << std::flush;
+    if (received.size() >= count)
+        cond.notify_all();
+}
+
+bool RangeSchedule::reclaim(uint32_t source)
+{
+    using namespace std::chrono;
+    auto now = high_resolution_clock::now();
+    std::lock_guard<std::mutex> lock(mtx);
+    RangeSource &s = sources[source];
+
+    /* Probing a source that stays quiet doesn't end, so it goes. */
+    if (now - s.heard_at > microseconds(RANGE_QUIET_DELAY)) {
+        drop(source);
+        return false;
+    }
+
+    /* The source serves what it is asked in order, so a chunk asked no
+     * later than one it delivered, and before it in the file, is lost once
+     * the reorder delay is over. */
+    for (auto it = requests.begin(); it != requests.end();) {
+        RangeRequest &r = it->second;
+        if (r.source != source) {
+            ++it;
+            continue;
+        }
+
+        if (r.behind_at == time_p{} && r.requested_at <= s.rack_requested_at &&
+            it->first < s.rack_index)
+            r.behind_at = now;
+
+        bool lost = r.behind_at != time_p{} &&
+                    now - r.behind_at >= microseconds(NACK_REORDER_DELAY);
+        bool stale = now - r.requested_at >= microseconds(RANGE_STALL_DELAY);
+        if (lost || stale) {
+            returned.insert(it->first);
+            --s.outstanding;
+            it = requests.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    update_rate(s, now);
+    return true;
+}
+
+void RangeSchedule::assign(uint32_t source, int64_t srtt_us,
+                           std::vector<std::pair<uint64_t, uint32_t>> &ranges)
+{
+    using namespace std::chrono;
+    auto now = high_resolution_clock::now();
+    std::lock_guard<std::mutex> lock(mtx);
+    RangeSource &s = sources[source];
+    if (!set_up || !s.joined)
+        return;
+
+    /* About two pipeline delays worth at its rate, the extra is what lets a
+     * faster source show it is faster. */
+    uint64_t target = std::clamp<uint64_t>(
+        static_cast<uint64_t>(2.0 * s.rate *
+                              (srtt_us + RANGE_PIPELINE_DELAY) / 1e6),
+        RANGE_MIN_OUTSTANDING, RANGE_MAX_OUTSTANDING);
+
+    /* A stalled source is probed with new chunks only while another one
+     * delivers, what was taken back is left to that one. */
+    bool probing = stalled(s, now);
+    bool others = std::any_of(
+        sources.begin(), sources.end(), [this, &s, now](const RangeSource &o) {
+            return &o != &s && o.joined && !stalled(o, now);
+        });
+    if (probing)
+        target = 1;
+
+    /* Chunks taken back first, they hold up the end of the file. */
+    while (s.outstanding < target) {
+        uint64_t index = 0;
+        if (!returned.empty() && !(probing && others)) {
+            index = *returned.begin();
+            returned.erase(returned.begin());
+            if (received.contains(index))
+                continue;
+        } else if (cursor < count) {
+            index = cursor++;
+        } else {
+            break;
+        }
+
+        requests[index] = RangeRequest{
+            .source = source, .requested_at = now, .behind_at{}};
+        ++s.outstanding;
+
+        if (!ranges.empty() &&
+            ranges.back().first + ranges.back().second == index &&
+            ranges.back().second < RANGE_MAX_LEN)
+            ++ranges.back().second;
+        else
+            ranges.emplace_back(index, 1);
+    }
+}
+
+bool RangeSchedule::done()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return is_done();
+}
+
+bool RangeSchedule::complete()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return set_up && received.size() >= count;
+}
+
+void RangeSchedule::wait_done()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    cond.wait(lock, [this] { return is_done() || stop; });
+}
+
+bool RangeSchedule::joined(uint32_t source)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return sources[source].joined;
+}
+
+uint64_t RangeSchedule::delivered(uint32_t source)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return sources[source].delivered;
+}
+
+uint64_t RangeSchedule::chunk_count()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return count;
+}
+
+uint64_t RangeSchedule::file_size()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return f_size;
+}
+
+std::string RangeSchedule::sha()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return file_sha;
+}
+
+bool RangeSchedule::stalled(const RangeSource &s, time_p now) const
+{
+    return now - s.heard_at > std::chrono::microseconds(RANGE_STALL_DELAY);
+}
+
+bool RangeSchedule::is_done()
+{
+    if (!error.empty() || (set_up && received.size() >= count))
+        return true;
+
+    return std::all_of(sources.begin(), sources.end(),
+                       [](const RangeSource &s) { return s.left; });
+}
+
+void RangeSchedule::update_rate(RangeSource &s, time_p now)
+{
+    using namespace std::chrono;
+    auto elapsed = duration_cast<microseconds>(now - s.interval_at).count();
+    if (elapsed < RANGE_RATE_INTERVAL)
+        return;
+
+    double sample = s.interval_delivered * 1e6 / elapsed;
+    s.rate = s.rate == 0.0 ? sample
+                           : s.rate + (sample - s.rate) * RANGE_RATE_GAIN;
+    s.interval_delivered = 0;
+    s.interval_at = now;
+}
@@ -0,0 +1,137 @@
+#include "range_transmitter.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define RANGE_REQUEST_LEN 12 // First chunk (8) and chunk count (4).
+#define RANGE_TICK 10000     // [us] Puller's check for stalls and new ranges.
+#define RANGE_END_COPIES 3   // Copies of the unacknowledged end of a pull.
+
+RangeTransmitter::RangeTransmitter(std::string &dest_ip, Session &session,
+                                   OutQueue &out_queue,
+                                   RangeSchedule &schedule, uint32_t source)
+    : Transmitter{dest_ip, 0, 0, session, out_queue, 1, 1},
+      schedule{&schedule}, source{source}
+{
+}
+
+RangeTransmitter::RangeTransmitter(std::string &dest_ip, Session &session,
+                                   OutQueue &out_queue)
+    : Transmitter{dest_ip, 0, 0, session, out_queue, 1, 1}
+{
+}
+
+RangeTransmitter::~RangeTransmitter()
+{
+    if (file_fd >= 0)
+        close(file_fd);
+}
+
+void RangeTransmitter::start_pulling()
+{
+    session.tick_delay = RANGE_TICK;
+    request_ranges();
+}
+
+void RangeTransmitter::pull_ranges(const std::vector<MainEvent> &evs)
+{
+    for (const MainEvent &ev : evs) {
+        if (ev.type == MainEventType::M_CHUNK && ev.msg_id > 0)
+            schedule->deliver(source, ev.msg_id - 1, ev.content);
+    }
+
+    if (schedule->done()) {
+        send_end();
+        done = true;
+        return;
+    }
+
+    if (!schedule->reclaim(source)) {
+        std::cout << dest_ip << " went quiet, given up on." << std::endl;
+        done = true;
+        return;
+    }
+    request_ranges();
+}
+
+void RangeTransmitter::request_ranges()
+{
+    std::vector<std::pair<uint64_t, uint32_t>> ranges;
+    schedule->assign(source, rtt.srtt(), ranges);
+
+    /* The first chunk is the ID as well, so requests bundle. */
+    for (const auto &[first, count] : ranges) {
+        std::vector<std::byte> content(RANGE_REQUEST_LEN);
+        memcpy(&content[0], &first, sizeof(first));
+        memcpy(&content[sizeof(first)], &count, sizeof(count));
+        OutEvent e{content, first, dest_ip, OutEventType::O_RANGE, session.id};
+        out_queue.push(e);
+    }
+}
+
+void RangeTransmitter::send_end()
+{
+    std::vector<std::byte> content(RANGE_REQUEST_LEN);
+    OutEvent e{content, 0, dest_ip, OutEventType::O_RANGE, session.id};
+    for (uint32_t i = 0; i < RANGE_END_COPIES; ++i)
+        out_queue.push(e);
+}
+
+void RangeTransmitter::start_serving(const std::string &filename,
+                                     const SessionParams &params)
+{
+    file_fd = open(filename.c_str(), O_RDONLY);
+    if (file_fd < 0)
+        throw std::runtime_error("Couldn't open file :( " + filename);
+
+    file_len = params.f_size;
+    chunk_len = params.chunk_len;
+    chunk_count = (file_len + chunk_len - 1) / chunk_len;
+    session.tick_delay = MIN_TICK;
+}
+
+void RangeTransmitter::serve_ranges(const std::vector<MainEvent> &evs)
+{
+    for (const MainEvent &ev : evs) {
+        if (ev.type != MainEventType::M_RANGE ||
+            ev.content.size() != RANGE_REQUEST_LEN)
+            continue;
+
+        uint64_t first = 0;
+        uint32_t count = 0;
+        memcpy(&first, &ev.content[0], sizeof(first));
+        memcpy(&count, &ev.content[sizeof(first)], sizeof(count));
+
+        /* An empty range ends the pull. */
+        if (count == 0) {
+            done = true;
+            return;
+        }
+        uint64_t last = std::min<uint64_t>(first + count, chunk_count);
+        for (uint64_t i = first; i < last; ++i)
+            wanted.insert(i);
+    }
+
+    /* The session's share drains the queue, keep it just full. */
+    while (!wanted.empty() && out_queue.queued(session.id) < OUT_BACKLOG) {
+        uint64_t index = *wanted.begin();
+        wanted.erase(wanted.begin());
+        OutEvent e{read_chunk(index), index + 1, dest_ip, OutEventType::O_CHUNK,
+                   session.id};
+        out_queue.push(e);
+        ++served_count;
+    }
+}
+
+std::vector<std::byte> RangeTransmitter::read_chunk(uint64_t index)
+{
+    /* Every chunk but the last is chunk_len long, at its own offset. */
+    off_t offset = static_cast<off_t>(index) * chunk_len;
+    size_t len = std::min<uint64_t>(chunk_len, file_len - offset);
+    std::vector<std::byte> data(len);
+    if (len > 0 &&
+        pread(file_fd, &data[0], len, offset) != static_cast<ssize_t>(len))
+        throw std::runtime_error("Couldn't read file :( ");
+
+    return data;
+}
@@ -0,0 +1,39 @@
+#include "received_set.h"
+
+ReceivedSet::ReceivedSet(uint64_t base) : first{base}, base{base} {}
+
+bool ReceivedSet::insert(uint64_t id)
+{
+    if (id < base)
+        return false;
+
+    const uint64_t bit = id - base;
+    if (bit / 64 >= words.size())
+        words.resize(bit / 64 + 1, 0);
+
+    uint64_t &word = words[bit / 64];
+    const uint64_t mask = uint64_t{1} << (bit % 64);
+    if (word & mask)
+        return false;
+
+    word |= mask;
+    ++count;
+
+    while (!words.empty() && words.front() == UINT64_MAX) {
+        words.pop_front();
+        base += 64;
+    }
+    return true;
+}
+
+bool ReceivedSet::contains(uint64_t id) const
+{
+    if (id < base)
+        return id >= first;
+
+    const uint64_t bit = id - base;
+    return bit / 64 < words.size() &&
+           (words[bit / 64] >> (bit % 64) & uint64_t{1});
+}
+
+size_t ReceivedSet::size() const { return count; }
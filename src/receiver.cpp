@@ -1,6 +1,6 @@
 #include "receiver.h"
 
-Receiver::Receiver(int own_port)
+Receiver::Receiver(int own_port, const std::string &group)
 {
     /* Create socket. */
 
@@ -18,6 +18,12 @@ Receiver::Receiver(int own_port)
     own_addr.sin_addr.s_addr = INADDR_ANY;
     own_addr.sin_port = htons(own_port);
 
+    /* Every member of a group on this host gets its own copy. */
+
+    int reuse = 1;
+    if (!group.empty())
+        setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
     /* Bind socket to be able to listen on specific port. */
 
     if (bind(sockfd, (const struct sockaddr *)&own_addr, sizeof(own_addr)) <
@@ -26,12 +32,30 @@ Receiver::Receiver(int own_port)
         close(sockfd);
     }
 
+    /* Join the group on the interface the routing table picks for it. */
+
+    if (!group.empty()) {
+        struct ip_mreq mreq;
+        memset(&mreq, 0, sizeof(mreq));
+        inet_pton(AF_INET, group.c_str(), &mreq.imr_multiaddr);
+        mreq.imr_interface.s_addr = INADDR_ANY;
+        if (setsockopt(sockfd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq,
+                       sizeof(mreq)) < 0)
+            std::cerr << "Joining multicast group " << group << " failed."
+                      << std::endl;
+    }
+
     /* Set socket blocking timeout to maintain responsiveness. */
 
     struct timeval timeout;
     timeout.tv_sec = 0;
-    timeout.tv_usec = 200000;
+    timeout.tv_usec = RECV_TIMEOUT;
     setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    /* Large receive buffer, so a full congestion window fits in. */
+
+    int buf_len = SOCK_BUF_LEN;
+    setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &buf_len, sizeof(buf_len));
 }
 
 Receiver::~Receiver() { close(sockfd); }
@@ -43,7 +67,10 @@ std::string Receiver::listen_for_packets(std::vector<std::byte> &bytes)
         recvfrom(sockfd, buffer, PACKET_LEN, 0, (struct sockaddr *)&recv_addr,
                  &recv_addr_len);
 
-    if (recvd_bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    /* A stop and continue interrupts a receive with a timeout, it isn't
+     * restarted. */
+    if (recvd_bytes < 0 &&
+        (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
         return "";
     else if (recvd_bytes < 0)
         throw std::runtime_error("recvfrom failed.");
@@ -0,0 +1,42 @@
+#include "rtt_estimator.h"
+#include <algorithm>
+
+/* RFC 6298 smoothing factors: alpha = 1/8, beta = 1/4, K = 4. */
+#define RTT_ALPHA_SHIFT 3
+#define RTT_BETA_SHIFT 2
+#define RTT_K 4
+
+RttEstimator::RttEstimator()
+{
+    srtt_us = RESEND_DELAY;
+    rttvar_us = RESEND_DELAY / 2;
+    rto_us = RESEND_DELAY;
+}
+
+void RttEstimator::add_sample(int64_t rtt_us)
+{
+    rtt_us = std::max<int64_t>(rtt_us, 1);
+
+    if (!sampled) {
+        srtt_us = rtt_us;
+        rttvar_us = rtt_us / 2;
+        sampled = true;
+    } else {
+        int64_t err = std::abs(srtt_us - rtt_us);
+        rttvar_us += (err - rttvar_us) >> RTT_BETA_SHIFT;
+        srtt_us += (rtt_us - srtt_us) >> RTT_ALPHA_SHIFT;
+    }
+
+    /* Variance term is floored by the timeout tick granularity, otherwise a
+     * perfectly stable path would get RTO == SRTT. */
+    int64_t var = std::max<int64_t>(RTT_K * rttvar_us, MIN_TICK);
+    rto_us = std::clamp<int64_t>(srtt_us + var, MIN_RTO, MAX_RTO);
+}
+
+void RttEstimator::backoff() { rto_us = std::min<int64_t>(rto_us * 2, MAX_RTO); }
+
+int64_t RttEstimator::rto() const { return rto_us; }
+
+int64_t RttEstimator::srtt() const { return srtt_us; }
+
+bool RttEstimator::has_sample() const { return sampled; }
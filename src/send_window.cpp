@@ -0,0 +1,85 @@
+#include "send_window.h"
+
+/* Initial ring size, doubled whenever the window outgrows it. */
+#define SEND_WINDOW_INITIAL_LEN 64
+
+SendWindow::SendWindow()
+    : msgs(SEND_WINDOW_INITIAL_LEN), payloads(SEND_WINDOW_INITIAL_LEN)
+{
+}
+
+SentMessage &SendWindow::push(uint64_t id, const std::vector<std::byte> &content)
+{
+    return push(id, std::make_shared<const std::vector<std::byte>>(content));
+}
+
+SentMessage &SendWindow::push(
+    uint64_t id, std::shared_ptr<const std::vector<std::byte>> content)
+{
+    if (sent_count == 0)
+        base = end = id;
+    if (id != end)
+        throw std::runtime_error("Message IDs sent out of order.");
+
+    if (end - base >= msgs.size())
+        grow();
+
+    ++end;
+    ++sent_count;
+    payloads[slot(id)] = std::move(content);
+    SentMessage &msg = msgs[slot(id)];
+    msg = SentMessage{};
+    msg.id = id;
+
+    return msg;
+}
+
+SentMessage *SendWindow::find(uint64_t id)
+{
+    if (sent_count == 0 || id - base >= end - base)
+        return nullptr;
+
+    return &msgs[slot(id)];
+}
+
+std::shared_ptr<const std::vector<std::byte>>
+SendWindow::content(uint64_t id) const
+{
+    return payloads[slot(id)];
+}
+
+void SendWindow::ack(uint64_t id)
+{
+    SentMessage *msg = find(id);
+    if (!msg || msg->ackd)
+        return;
+
+    msg->ackd = true;
+    payloads[slot(id)].reset();
+    ++acked_count;
+
+    while (base != end && msgs[slot(base)].ackd)
+        ++base;
+}
+
+size_t SendWindow::sent() const { return sent_count; }
+
+size_t SendWindow::acked() const { return acked_count; }
+
+void SendWindow::grow()
+{
+    std::vector<SentMessage> new_msgs(msgs.size() * 2);
+    std::vector<std::shared_ptr<const std::vector<std::byte>>> new_payloads(
+        payloads.size() * 2);
+
+    const size_t mask = new_msgs.size() - 1;
+    for (uint64_t id = base; id != end; ++id) {
+        new_msgs[id & mask] = msgs[slot(id)];
+        new_payloads[id & mask] = std::move(payloads[slot(id)]);
+    }
+
+    msgs.swap(new_msgs);
+    payloads.swap(new_payloads);
+}
+
+size_t SendWindow::slot(uint64_t id) const { return id & (msgs.size() - 1); }
@@ -10,6 +10,10 @@ Sender::Sender(int dest_port)
     memset(&dest_addr, 0, sizeof(dest_addr));
     dest_addr.sin_family = AF_INET;
     dest_addr.sin_port = htons(dest_port);
+
+    /* Multicast may cross a few routers, not the default single hop. */
+    unsigned char ttl = MCAST_TTL;
+    setsockopt(sockfd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
 }
 
 Sender::~Sender() { close(sockfd); }
@@ -0,0 +1,7 @@
+#include "session.h"
+
+Session::Session(uint32_t id) : id{id}
+{
+    ticked_at = std::chrono::high_resolution_clock::now();
+    heard_at = ticked_at;
+}
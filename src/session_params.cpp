@@ -0,0 +1,174 @@
+#include "session_params.h"
+#include <algorithm>
+
+#define SESSION_MAGIC "UDPS"
+#define SESSION_MAGIC_LEN 4
+#define SESSION_FIXED_LEN 24 // Magic up to and including the name length.
+#define SESSION_MAX_NAME 256
+#define SESSION_SHA_LEN 64   // Hex SHA-256 of an inline or pulled file.
+
+/* Fields are little-endian on the wire, whatever the host is. */
+template <typename T> static void put(std::vector<std::byte> &out, T value)
+{
+    for (size_t i = 0; i < sizeof(T); ++i)
+        out.push_back(std::byte{static_cast<uint8_t>(value >> (8 * i))});
+}
+
+template <typename T>
+static T get(const std::vector<std::byte> &in, size_t &pos)
+{
+    T value = 0;
+    for (size_t i = 0; i < sizeof(T); ++i)
+        value |= static_cast<T>(std::to_integer<uint8_t>(in[pos + i]))
+                 << (8 * i);
+    pos += sizeof(T);
+    return value;
+}
+
+SessionParams local_session_params(TransferMode t_mode, uint64_t f_size,
+                                   const std::string &f_name)
+{
+    return SessionParams{.version = SESSION_VERSION,
+                         .t_mode = t_mode,
+                         .f_size = f_size,
+                         .chunk_len = DATA_LEN,
+                         .window = FLOW_WINDOW,
+                         .ack_copies = 1,
+                         .options = SESSION_OPT_FEC | SESSION_OPT_NACK |
+                                    SESSION_OPT_SHA256,
+                         .f_name = f_name.substr(0, SESSION_MAX_NAME),
+                         .deadline = 0,
+                         .sha{},
+                         .content{}};
+}
+
+SessionParams negotiate_session(const SessionParams &offer,
+                                const SessionParams &local)
+{
+    SessionParams agreed = offer;
+    agreed.version = std::min(offer.version, local.version);
+    agreed.chunk_len = std::min(offer.chunk_len, local.chunk_len);
+
+    agreed.window = std::min(offer.window, local.window);
+    agreed.ack_copies = std::max(offer.ack_copies, local.ack_copies);
+    agreed.options = offer.options & local.options;
+
+    return agreed;
+}
+
+bool fits_inline(const SessionParams &offer)
+{
+    size_t name_len = std::min<size_t>(offer.f_name.size(), SESSION_MAX_NAME);
+    return SESSION_FIXED_LEN + name_len + SESSION_SHA_LEN + offer.f_size <=
+           offer.chunk_len;
+}
+
+std::vector<std::byte> encode_session(const SessionParams &params)
+{
+    std::vector<std::byte> out;
+    out.reserve(SESSION_FIXED_LEN + params.f_name.size());
+
+    for (size_t i = 0; i < SESSION_MAGIC_LEN; ++i)
+        out.push_back(std::byte{static_cast<uint8_t>(SESSION_MAGIC[i])});
+    put<uint8_t>(out, params.version);
+    put<uint8_t>(out, params.t_mode);
+    put<uint64_t>(out, params.f_size);
+    put<uint16_t>(out, params.chunk_len);
+    put<uint32_t>(out, params.window);
+    put<uint8_t>(out, params.ack_copies);
+    put<uint8_t>(out, params.options);
+
+    std::string name = params.f_name.substr(0, SESSION_MAX_NAME);
+    put<uint16_t>(out, static_cast<uint16_t>(name.size()));
+    for (char c : name)
+        out.push_back(std::byte{static_cast<unsigned char>(c)});
+
+    /* Version 3 added the deadline, older ends don't read one. */
+    if (params.t_mode == TransferMode::T_STREAM && params.version >= 3)
+        put<uint32_t>(out, params.deadline);
+
+    if (params.t_mode == TransferMode::T_INLINE) {
+        if (params.sha.size() != SESSION_SHA_LEN)
+            throw std::runtime_error("Inline file without a SHA.");
+        for (char c : params.sha)
+            out.push_back(std::byte{static_cast<unsigned char>(c)});
+        out.insert(out.end(), params.content.begin(), params.content.end());
+    }
+
+    if (params.t_mode == TransferMode::T_RANGE && !params.sha.empty()) {
+        if (params.sha.size() != SESSION_SHA_LEN)
+            throw std::runtime_error("Pulled file with a bad SHA.");
+        for (char c : params.sha)
+            out.push_back(std::byte{static_cast<unsigned char>(c)});
+    }
+
+    return out;
+}
+
+SessionParams decode_session(const std::vector<std::byte> &content)
+{
+    if (content.size() < SESSION_FIXED_LEN)
+        throw std::runtime_error("Invalid header: insufficient data.");
+
+    for (size_t i = 0; i < SESSION_MAGIC_LEN; ++i) {
+        if (std::to_integer<char>(content[i]) != SESSION_MAGIC[i])
+            throw std::runtime_error(
+                "Expected header, but got something else.");
+    }
+
+    size_t pos = SESSION_MAGIC_LEN;
+    SessionParams params;
+    params.version = get<uint8_t>(content, pos);
+    if (params.version == 0)
+        throw std::runtime_error("Unsupported header version.");
+
+    uint8_t t_mode = get<uint8_t>(content, pos);
+    if (t_mode > TransferMode::T_RANGE)
+        throw std::runtime_error("Unsupported transfer mode.");
+    params.t_mode = static_cast<TransferMode>(t_mode);
+    params.f_size = get<uint64_t>(content, pos);
+    params.chunk_len = get<uint16_t>(content, pos);
+    params.window = get<uint32_t>(content, pos);
+    params.ack_copies = get<uint8_t>(content, pos);
+    params.options = get<uint8_t>(content, pos);
+
+    uint16_t name_len = get<uint16_t>(content, pos);
+    if (content.size() < pos + name_len || name_len > SESSION_MAX_NAME)
+        throw std::runtime_error("Invalid header: bad file name length.");
+    params.f_name.assign(reinterpret_cast<const char *>(&content[pos]),
+                         name_len);
+    pos += name_len;
+
+    params.deadline = 0;
+    if (params.t_mode == TransferMode::T_STREAM && params.version >= 3) {
+        if (content.size() < pos + sizeof(uint32_t))
+            throw std::runtime_error("Invalid header: missing deadline.");
+        params.deadline = get<uint32_t>(content, pos);
+    }
+
+    if (params.t_mode == TransferMode::T_INLINE) {
+        if (content.size() != pos + SESSION_SHA_LEN + params.f_size)
+            throw std::runtime_error("Invalid header: bad inline file.");
+        params.sha.assign(reinterpret_cast<const char *>(&content[pos]),
+                          SESSION_SHA_LEN);
+        params.content.assign(content.begin() + pos + SESSION_SHA_LEN,
+                              content.end());
+    }
+
+    if (params.t_mode == TransferMode::T_RANGE &&
+        content.size() >= pos + SESSION_SHA_LEN) {
+        params.sha.assign(reinterpret_cast<const char *>(&content[pos]),
+                          SESSION_SHA_LEN);
+        pos += SESSION_SHA_LEN;
+    }
+
+    /* A stream's chunk length can't be negotiated down, a larger one than
+     * ours is refused with the reply rather than dropped here. */
+    bool too_long = params.chunk_len > DATA_LEN &&
+                    params.t_mode != TransferMode::T_STREAM;
+    if (params.chunk_len == 0 || too_long || params.window == 0 ||
+        params.ack_copies == 0)
+        throw std::runtime_error("Invalid header: bad session parameters.");
+
+    return params;
+}
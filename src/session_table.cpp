@@ -0,0 +1,122 @@
+#include "session_table.h"
+#include <random>
+
+std::shared_ptr<Session> SessionTable::find(uint32_t id)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    auto group = groups.find(id);
+    if (group != groups.end())
+        id = group->second;
+
+    auto it = sessions.find(id);
+    return it == sessions.end() ? nullptr : it->second;
+}
+
+std::shared_ptr<Session> SessionTable::open(uint32_t id, bool &opened)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    opened = false;
+    auto it = sessions.find(id);
+    if (it != sessions.end())
+        return it->second;
+    forget_closed(std::chrono::high_resolution_clock::now());
+    if (closed_ids.count(id) > 0)
+        return nullptr;
+
+    opened = true;
+    auto session = std::make_shared<Session>(id);
+    sessions[id] = session;
+    return session;
+}
+
+std::shared_ptr<Session> SessionTable::join(uint32_t group_id, bool &opened)
+{
+    static std::random_device random;
+    std::lock_guard<std::mutex> lock(mtx);
+    opened = false;
+    auto group = groups.find(group_id);
+    if (group != groups.end())
+        return sessions[group->second];
+    forget_closed(std::chrono::high_resolution_clock::now());
+    if (closed_ids.count(group_id) > 0)
+        return nullptr;
+
+    /* Any unused unicast ID, the sender only ever sees it from us. */
+    uint32_t id = 0;
+    do {
+        id = random() & ~MCAST_SESSION_BIT;
+    } while (sessions.count(id) > 0 || closed_ids.count(id) > 0);
+
+    opened = true;
+    auto session = std::make_shared<Session>(id);
+    session->multicast = true;
+    sessions[id] = session;
+    groups[group_id] = id;
+    return session;
+}
+
+std::shared_ptr<Session> SessionTable::find_multicast()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    for (auto &[id, session] : sessions)
+        if (id & MCAST_SESSION_BIT)
+            return session;
+
+    return nullptr;
+}
+
+void SessionTable::close(uint32_t id)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = sessions.find(id);
+    if (it == sessions.end())
+        return;
+
+    auto now = std::chrono::high_resolution_clock::now();
+    it->second->closed = true;
+    sessions.erase(it);
+    forget_closed(now);
+    remember_closed(id, now);
+
+    for (auto group = groups.begin(); group != groups.end(); ++group) {
+        if (group->second == id) {
+            remember_closed(group->first, now);
+            groups.erase(group);
+            break;
+        }
+    }
+}
+
+std::vector<std::shared_ptr<Session>> SessionTable::all()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    std::vector<std::shared_ptr<Session>> list;
+    list.reserve(sessions.size());
+    for (auto &[id, session] : sessions)
+        list.push_back(session);
+
+    return list;
+}
+
+void SessionTable::remember_closed(uint32_t id, time_p now)
+{
+    if (closed_ids.emplace(id, now).second)
+        closed_order.push_back(id);
+}
+
+void SessionTable::forget_closed(time_p now)
+{
+    /* Closed in order, the oldest are up front. */
+    auto timeout = std::chrono::microseconds(SESSION_IDLE_TIMEOUT);
+    while (!closed_order.empty() &&
+           now - closed_ids[closed_order.front()] > timeout) {
+        closed_ids.erase(closed_order.front());
+        closed_order.pop_front();
+    }
+}
+
+void SessionTable::notify_all()
+{
+    for (auto &session : all())
+        session->main_queue.cond.notify_all();
+}
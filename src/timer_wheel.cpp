@@ -0,0 +1,84 @@
+#include "timer_wheel.h"
+#include <algorithm>
+
+/* Slots of MIN_TICK each, one revolution covers a couple of typical RTOs. */
+#define WHEEL_SLOTS 1024
+
+TimerWheel::TimerWheel()
+    : start{std::chrono::high_resolution_clock::now()}, slots(WHEEL_SLOTS)
+{
+}
+
+void TimerWheel::arm(uint64_t id, time_p deadline)
+{
+    cancel(id);
+
+    /* Never into a tick that was already expired, it wouldn't be seen again
+     * until the wheel comes around. */
+    uint64_t tick = std::max(
+        (elapsed_us(deadline) + MIN_TICK - 1) / MIN_TICK, cursor + 1);
+    auto &slot = slots[tick % WHEEL_SLOTS];
+    slot.push_back(id);
+    timers[id] = Timer{.tick = tick, .pos = std::prev(slot.end())};
+}
+
+void TimerWheel::cancel(uint64_t id)
+{
+    auto it = timers.find(id);
+    if (it == timers.end())
+        return;
+
+    slots[it->second.tick % WHEEL_SLOTS].erase(it->second.pos);
+    timers.erase(it);
+}
+
+void TimerWheel::expire(time_p now, std::vector<uint64_t> &expired)
+{
+    /* Deadlines are rounded up, so everything up to the current (whole)
+     * tick has passed. */
+    uint64_t now_tick = elapsed_us(now) / MIN_TICK;
+    if (now_tick <= cursor)
+        return;
+
+    /* After a long gap every slot is due at most once. */
+    uint64_t from = cursor + 1;
+    if (now_tick - cursor > WHEEL_SLOTS)
+        from = now_tick - WHEEL_SLOTS + 1;
+
+    for (uint64_t t = from; t <= now_tick; ++t) {
+        auto &slot = slots[t % WHEEL_SLOTS];
+        for (auto it = slot.begin(); it != slot.end();) {
+            if (timers[*it].tick > now_tick) {
+                ++it;
+                continue;
+            }
+            expired.push_back(*it);
+            timers.erase(*it);
+            it = slot.erase(it);
+        }
+    }
+
+    cursor = now_tick;
+}
+
+std::vector<uint64_t> TimerWheel::armed() const
+{
+    std::vector<uint64_t> ids;
+    ids.reserve(timers.size());
+    for (const auto &timer : timers)
+        ids.push_back(timer.first);
+
+    return ids;
+}
+
+size_t TimerWheel::size() const { return timers.size(); }
+
+uint64_t TimerWheel::elapsed_us(time_p t) const
+{
+    using namespace std::chrono;
+
+    if (t <= start)
+        return 0;
+
+    return duration_cast<microseconds>(t - start).count();
+}
@@ -0,0 +1,50 @@
+#include "token_bucket.h"
+#include <algorithm>
+
+TokenBucket::TokenBucket(double rate)
+{
+    filled_at = std::chrono::high_resolution_clock::now();
+    set_rate(rate);
+}
+
+void TokenBucket::set_rate(double rate)
+{
+    bytes_per_s = std::max(rate, 0.0);
+    tokens = std::min(tokens, bytes_per_s * RATE_BURST / 1e6);
+}
+
+double TokenBucket::rate() const { return bytes_per_s; }
+
+bool TokenBucket::limited() const { return bytes_per_s > 0.0; }
+
+bool TokenBucket::has_room(time_p now)
+{
+    using namespace std::chrono;
+    if (bytes_per_s <= 0.0)
+        return true;
+
+    /* At least a full packet of depth, so a low rate still sends. */
+    double elapsed = duration_cast<microseconds>(now - filled_at).count();
+    double depth = std::max<double>(bytes_per_s * RATE_BURST / 1e6, PACKET_LEN);
+    tokens = std::min(depth, tokens + elapsed * bytes_per_s / 1e6);
+    filled_at = now;
+
+    return tokens > 0.0;
+}
+
+void TokenBucket::take(size_t bytes)
+{
+    if (bytes_per_s > 0.0)
+        tokens -= bytes;
+}
+
+time_p TokenBucket::ready_at() const
+{
+    using namespace std::chrono;
+    if (bytes_per_s <= 0.0 || tokens > 0.0)
+        return filled_at;
+
+    /* Just past paying back the debt. */
+    auto wait = static_cast<int64_t>(-tokens * 1e6 / bytes_per_s) + 1;
+    return filled_at + microseconds(wait);
+}
@@ -1,54 +1,87 @@
 #include "transmitter.h"
+#include <algorithm>
+
+/* Weight of a single message in the loss rate average. */
+#define LOSS_EWMA_GAIN 0.01
+
+/* RACK reorder window as a fraction of SRTT and tail probe timeout in SRTTs. */
+#define RACK_REORDER_DIV 4
+#define TLP_SRTTS 2
 
 Transmitter::Transmitter(std::string &dest_ip, size_t out_msg_count,
-                         size_t in_msg_count, Queue<MainEvent> &main_queue,
-                         Queue<OutEvent> &out_queue, uint32_t min_ack_id,
-                         uint32_t min_msg_id)
-    : main_queue{main_queue}, out_queue{out_queue}, out_msg_count{out_msg_count}
+                         size_t in_msg_count, Session &session,
+                         OutQueue &out_queue, uint64_t min_ack_id,
+                         uint64_t min_msg_id)
+    : session{session}, out_queue{out_queue}, recvd_ids{min_msg_id},
+      out_msg_count{out_msg_count}
 {
     this->dest_ip = dest_ip;
     this->in_msg_count = in_msg_count;
     this->min_msg_id = min_msg_id;
     this->min_ack_id = min_ack_id;
     this->mode = TransmitterMode::SEND;
+    this->cc = make_congestion_control(CongestionMode::CC_CUBIC);
 }
 
-Transmitter::Transmitter(size_t in_msg_count, Queue<MainEvent> &main_queue,
-                         Queue<OutEvent> &out_queue, uint32_t min_ack_id,
-                         uint32_t min_msg_id)
-    : main_queue{main_queue}, out_queue{out_queue}, out_msg_count{0}
+Transmitter::Transmitter(size_t in_msg_count, Session &session,
+                         OutQueue &out_queue, uint64_t min_ack_id,
+                         uint64_t min_msg_id)
+    : session{session}, out_queue{out_queue}, recvd_ids{min_msg_id},
+      out_msg_count{0}
 {
     this->dest_ip = "";
     this->in_msg_count = in_msg_count;
     this->min_msg_id = min_msg_id;
     this->min_ack_id = min_ack_id;
     this->mode = TransmitterMode::RECEIVE;
+    this->cc = make_congestion_control(CongestionMode::CC_CUBIC);
 }
 
 Transmitter::~Transmitter() {}
 
 void Transmitter::send_msg(std::vector<std::byte> &data)
 {
-    const uint32_t id = next_id++;
-    SentMessage sent_message{.ackd = false,
-                             .content = data,
-                             .id = id,
-                             .retries = 1,
-                             .sent_at =
-                                 std::chrono::high_resolution_clock::now()};
+    send_msg(std::make_shared<const std::vector<std::byte>>(data));
+}
+
+void Transmitter::send_msg(std::shared_ptr<const std::vector<std::byte>> data)
+{
+    using namespace std::chrono;
+    auto now = high_resolution_clock::now();
+
+    /* Nothing in the air, so the delivery rate interval starts now. */
+    if (in_flight == 0)
+        delivered_at = now;
+
+    const uint64_t id = session.next_id++;
+    SentMessage &msg = sent_msgs.push(id, data);
+    msg.retries = 1;
+    msg.sent_at = now;
+    msg.delivered = delivered;
+    msg.delivered_at = delivered_at;
+
+    ++in_flight;
+    progress_at = now;
+    timers.arm(id, now + microseconds(rtt.rto()));
 
-    sent_msgs[id] = sent_message;
-    OutEvent e{sent_message.content, id, dest_ip, OutEventType::O_MSG};
+    /* Space new messages by the pacing rate, allowing at most one tick worth
+     * of burst after an idle period. */
+    double rate = pacing_rate();
+    if (rate > 0.0) {
+        auto interval = microseconds(static_cast<int64_t>(1e6 / rate));
+        next_send_at = std::max(next_send_at, now - microseconds(MIN_TICK));
+        next_send_at += interval;
+    }
+    OutEvent e{{}, id, dest_ip, OutEventType::O_MSG, session.id, data};
     out_queue.push(e);
 };
 
 void Transmitter::receive_msg(MainEvent ev)
 {
     this->src_ip = ev.origin_ip;
-    recvd_msgs[ev.msg_id] = RecvdMessage{
-        .content = ev.content,
-        .received_at = std::chrono::high_resolution_clock::now(),
-    };
+    recvd_ids.insert(ev.msg_id);
+    if (keeps_content(ev.msg_id))
+        recvd_msgs[ev.msg_id] = ev.content;
     check_completion();
 }
 
@@ -57,73 +90,304 @@ void Transmitter::resend_msg(SentMessage &msg)
     using namespace std::chrono;
     auto now = high_resolution_clock::now();
 
+    /* Late data is worth nothing to a partially reliable session. */
+    if (msg.expires_at != time_p{} && now >= msg.expires_at) {
+        expire_msg(msg);
+        return;
+    }
+
     ++msg.retries;
     msg.sent_at = now;
+    msg.delivered = delivered;
+    msg.delivered_at = delivered_at;
     if (msg.retries > MAX_RETRIES) {
         throw std::runtime_error("Out of attempts for message.");
     }
-    OutEvent e{msg.content, msg.id, dest_ip, OutEventType::O_MSG};
-    out_queue.push(e);
+    timers.arm(msg.id, now + microseconds(rtt.rto()));
+    OutEvent e{{},         msg.id,     dest_ip, OutEventType::O_MSG,
+               session.id, sent_msgs.content(msg.id)};
+    out_queue.push(e, OutLane::L_RESEND);
 }
 
 void Transmitter::set_ack(MainEvent ev)
 {
     /* If this is an ACK for something that was not sent,
-     * then it's a corrupted ACK and it will be missing somewhere... */
-    if (sent_msgs.find(ev.msg_id) != sent_msgs.end()) {
-        sent_msgs[ev.msg_id].ackd = (int)ev.content[0] > 128;
-        if (sent_msgs[ev.msg_id].ackd)
-            sent_msgs[ev.msg_id].content = std::vector<std::byte>{0};
-        else
-            resend_msg(sent_msgs[ev.msg_id]);
-
-        check_completion();
+     * then it's a corrupted ACK and it will be missing somewhere...
+     * Messages behind the window were ACKed already, but their ACKs
+     * still carry the receiver's window. */
+    uint32_t ack_stamp = 0;
+    if (ev.content.size() >= ACK_LEN) {
+        uint32_t wire_limit = 0;
+        memcpy(&wire_limit, &ev.content[1], sizeof(wire_limit));
+        memcpy(&ack_stamp, &ev.content[1 + sizeof(wire_limit)],
+               sizeof(ack_stamp));
+
+        /* Late or reordered ACKs carry an older limit, it only moves
+         * forward once the receiver's own is in. */
+        uint64_t limit = expand_id(wire_limit, session.next_id);
+        if (!heard_limit || limit > peer_limit)
+            peer_limit = limit;
+        heard_limit = true;
+    }
+
+    SentMessage *msg = sent_msgs.find(ev.msg_id);
+    if (!msg || msg->ackd)
+        return;
+
+    if ((int)ev.content[0] > 128) {
+        on_first_ack(*msg, ev.content[0] == std::byte{ACK_RECOVERED},
+                     ack_stamp);
+        sent_msgs.ack(ev.msg_id);
+    } else {
+        /* Negative ACK, the message was corrupted on the way. */
+        cc->on_loss(msg->sent_at, std::chrono::high_resolution_clock::now());
+        update_loss_rate(true);
+        resend_msg(*msg);
+    }
+
+    check_completion();
+}
+
+void Transmitter::receive_nack(MainEvent ev)
+{
+    using namespace std::chrono;
+    auto now = high_resolution_clock::now();
+
+    const size_t n = ev.content.size() / sizeof(uint32_t);
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t wire_id = 0;
+        memcpy(&wire_id, &ev.content[i * sizeof(uint32_t)], sizeof(wire_id));
+        uint64_t id = expand_id(wire_id, session.next_id);
+
+        SentMessage *m = sent_msgs.find(id);
+        if (!m || m->ackd)
+            continue;
+
+        /* A resend less than an RTT ago can't have been seen as missing
+         * yet, this NACK crossed it on the way. */
+        auto &msg = *m;
+        if (duration_cast<microseconds>(now - msg.sent_at).count() <
+            rtt.srtt())
+            continue;
+
+        cc->on_loss(msg.sent_at, now);
+        update_loss_rate(true);
+        resend_msg(msg);
     }
 }
 
 void Transmitter::check_completion()
 {
     /* Check for completion. */
-    bool all_ackd = true;
-    for (const auto &msg : sent_msgs) {
-        if (!msg.second.ackd) {
-            all_ackd = false;
-            break;
+    this->done = recvd_ids.size() >= in_msg_count &&
+                 sent_msgs.sent() == out_msg_count &&
+                 sent_msgs.acked() == sent_msgs.sent();
+}
+
+bool Transmitter::keeps_content(uint64_t msg_id) const
+{
+    (void)msg_id;
+    return true;
+}
+
+bool Transmitter::may_send()
+{
+    if (in_flight >= cc->window() || session.next_id >= peer_limit ||
+        out_queue.queued(session.id) >= OUT_BACKLOG)
+        return false;
+
+    return pacing_rate() <= 0.0 ||
+           std::chrono::high_resolution_clock::now() >= next_send_at;
+}
+
+double Transmitter::pacing_rate()
+{
+    /* Data sent faster than the session's share of the link only queues up
+     * behind its cap, and the queueing looks like RTT to the resend timers. */
+    double rate = cc->pacing_rate();
+    double cap = out_queue.rate_cap(session.id) / PACKET_LEN;
+    if (cap > 0.0 && (rate <= 0.0 || cap < rate))
+        rate = cap;
+
+    return rate;
+}
+
+void Transmitter::detect_losses()
+{
+    using namespace std::chrono;
+    auto now = high_resolution_clock::now();
+
+    if (!rtt.has_sample())
+        return;
+
+    /* RACK: a message sent before one that has since been ACKed is lost once
+     * it is older than an RTT plus a reorder window. Its resend is newer than
+     * everything ACKed, so it waits for the next ACK to be judged again. */
+    const int64_t limit =
+        rtt.srtt() +
+        std::max<int64_t>(rtt.srtt() / RACK_REORDER_DIV, MIN_TICK);
+
+    for (uint64_t id : timers.armed()) {
+        auto &m = *sent_msgs.find(id);
+        if (m.sent_at >= rack_sent_at)
+            continue;
+
+        if (duration_cast<microseconds>(now - m.sent_at).count() > limit) {
+            cc->on_loss(m.sent_at, now);
+            update_loss_rate(true);
+            resend_msg(m);
         }
     }
+}
+
+void Transmitter::send_tail_probe()
+{
+    using namespace std::chrono;
+    auto now = high_resolution_clock::now();
+
+    if (in_flight == 0 || probe_out || !rtt.has_sample())
+        return;
 
-    this->done = recvd_msgs.size() >= in_msg_count &&
-                 sent_msgs.size() == out_msg_count && all_ackd;
+    auto idle = duration_cast<microseconds>(now - progress_at).count();
+    if (idle < TLP_SRTTS * rtt.srtt() + MIN_TICK)
+        return;
+
+    /* Nothing sent or ACKed for a while: resend the newest outstanding
+     * message, so its ACK (or the NACKs it triggers) reveals tail losses
+     * before the RTO does. */
+    auto ids = timers.armed();
+    if (!ids.empty()) {
+        uint64_t last = *std::max_element(ids.begin(), ids.end());
+        resend_msg(*sent_msgs.find(last));
+        probe_out = true;
+    }
+}
+
+void Transmitter::expire_msg(SentMessage &msg)
+{
+    /* Out of the window as if ACKed, the receiver skips it after the same
+     * deadline. */
+    --in_flight;
+    timers.cancel(msg.id);
+    ++expired_count;
+    progress_at = std::chrono::high_resolution_clock::now();
+    sent_msgs.ack(msg.id);
 }
 
 void Transmitter::check_resends()
 {
     using namespace std::chrono;
+
+    detect_losses();
+    send_tail_probe();
+
     auto now = high_resolution_clock::now();
+    std::vector<uint64_t> expired;
+    timers.expire(now, expired);
+    if (expired.empty())
+        return;
 
-    for (auto &msg : sent_msgs) {
-        auto &m = msg.second;
-        auto duration = duration_cast<microseconds>(now - m.sent_at);
-        if (duration.count() > RESEND_DELAY && !m.ackd)
-            resend_msg(m);
+    /* Back off once per expiry round, not once per expired message, so a
+     * lost window doesn't blow the RTO up to MAX_RTO in a single tick. The
+     * resends are armed with the backed off RTO. */
+    rtt.backoff();
+    cc->on_timeout(now);
+    update_tick_delay();
+
+    for (uint64_t id : expired) {
+        update_loss_rate(true);
+        resend_msg(*sent_msgs.find(id));
+    }
+}
+
+void Transmitter::on_first_ack(const SentMessage &msg, bool recovered,
+                               uint32_t ack_stamp)
+{
+    using namespace std::chrono;
+    auto now = high_resolution_clock::now();
+    --in_flight;
+    timers.cancel(msg.id);
+
+    /* Delivery rate sample over the time the message was in the air. */
+    ++delivered;
+    delivered_at = now;
+    bool round_start = msg.delivered >= next_round_delivered;
+    if (round_start)
+        next_round_delivered = delivered;
+
+    /* A message the receiver rebuilt from FEC parity was lost on the way,
+     * even though it never had to be resent. */
+    update_loss_rate(recovered);
+
+    /* Karn's algorithm: only messages sent exactly once give an
+     * unambiguous RTT sample. Recovered messages waited for their parity. */
+    int64_t sample = -1;
+    if (msg.retries == 1 && !recovered) {
+        sample = duration_cast<microseconds>(now - msg.sent_at).count();
+        rtt.add_sample(sample);
+        update_tick_delay();
     }
+
+    /* Anything sent before this message and still unACKed is now suspect. */
+    rack_sent_at = std::max(rack_sent_at, msg.sent_at);
+    progress_at = now;
+    probe_out = false;
+
+    cc->on_ack(AckSample{.now = now,
+                         .sent_at = msg.sent_at,
+                         .rtt_us = sample,
+                         .one_way_us = ack_stamp - wire_stamp(msg.sent_at),
+                         .srtt_us = rtt.srtt(),
+                         .in_flight = in_flight,
+                         .delivered = delivered - msg.delivered,
+                         .interval_us = duration_cast<microseconds>(
+                                            now - msg.delivered_at)
+                                            .count(),
+                         .round_start = round_start});
+}
+
+void Transmitter::update_loss_rate(bool lost)
+{
+    loss_rate += ((lost ? 1.0 : 0.0) - loss_rate) * LOSS_EWMA_GAIN;
+}
+
+void Transmitter::update_tick_delay()
+{
+    /* Check a few times per RTO so a timeout is noticed reasonably close to
+     * its deadline. */
+    session.tick_delay = static_cast<uint32_t>(
+        std::clamp<int64_t>(rtt.rto() / 4, MIN_TICK, RESEND_DELAY));
+
+    /* A paced sender needs to wake up regularly even without ACKs. */
+    if (pacing_rate() > 0.0)
+        session.tick_delay = MIN_TICK;
 }
 
 void Transmitter::run_main_body(
     std::function<void(std::vector<MainEvent>)> iter_func)
 {
-    while (!this->done && !stop) {
-        std::vector<MainEvent> evs = main_queue.wait_nonempty();
-        if (this->done || stop) {
+    /* Messages meant for the next transmitter, which arrived early. */
+    std::vector<MainEvent> deferred;
+
+    while (!this->done && !stop && !session.closed) {
+        std::vector<MainEvent> evs = session.main_queue.wait_nonempty();
+        if (this->done || stop || session.closed) {
             break;
         }
-        for (MainEvent ev : evs) {
+
+        size_t handled = 0;
+        bool got_ack = false;
+        for (; handled < evs.size() && !this->done; ++handled) {
+            MainEvent &ev = evs[handled];
             switch (ev.type) {
             case MainEventType::M_MSG:
                 /* Don't accept duplicate messages or messages intended for
-                 * previous transmitters. */
-                if (ev.msg_id >= this->min_msg_id &&
-                    recvd_msgs.find(ev.msg_id) == recvd_msgs.end())
+                 * previous transmitters. Keep the ones for later
+                 * transmitters. */
+                if (ev.msg_id >= this->min_msg_id + this->in_msg_count)
+                    deferred.push_back(ev);
+                else if (ev.msg_id >= this->min_msg_id &&
+                         !recvd_ids.contains(ev.msg_id))
                     this->receive_msg(ev);
                 break;
             case MainEventType::M_ACK:
@@ -131,8 +395,21 @@ void Transmitter::run_main_body(
                  * transmitters.
                  */
                 if (ev.msg_id >= this->min_ack_id &&
-                    mode == TransmitterMode::SEND)
+                    mode == TransmitterMode::SEND) {
                     this->set_ack(ev);
+                    got_ack = true;
+                }
+                break;
+            case MainEventType::M_NACK:
+                if (mode == TransmitterMode::SEND)
+                    this->receive_nack(ev);
+                break;
+            case MainEventType::M_FEC:
+            case MainEventType::M_SYM:
+            case MainEventType::M_RANGE:
+            case MainEventType::M_CHUNK:
+                /* Parity, symbols and ranges are left to the file
+                 * transmitters. */
                 break;
             case MainEventType::M_TIO:
                 this->check_resends();
@@ -140,6 +417,16 @@ void Transmitter::run_main_body(
             }
         }
 
+        if (got_ack && !this->done)
+            detect_losses();
+
+        /* Once done, the rest of the batch belongs to the next transmitter. */
+        deferred.insert(deferred.end(), evs.begin() + handled, evs.end());
+        evs.resize(handled);
+
         iter_func(evs);
     }
+
+    if (!stop && !deferred.empty())
+        session.main_queue.push_front(deferred);
 }
\ No newline at end of file
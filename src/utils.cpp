@@ -1,40 +1,222 @@
 #include "utils.h"
 #include "sha256.h"
+#include <algorithm>
+#include <arpa/inet.h>
 
-void msg2packet(std::vector<std::byte> &packet, uint32_t id, OutEventType type,
-                std::vector<std::byte> &data)
+const std::vector<std::byte> &event_content(const OutEvent &ev)
 {
-    packet.resize(1 + sizeof(id) + data.size() + CRC_LEN);
-    packet[0] = (std::byte)type; /* 0 - Message, 1 - Ack */
-    memcpy(&packet[1], &id, sizeof(id));
-    memcpy(&packet[1 + sizeof(id)], &data[0], data.size());
-    size_t data_len = 1 + sizeof(id) + data.size();
+    return ev.shared ? *ev.shared : ev.content;
+}
+
+void append_frame(std::vector<std::byte> &packet, const OutEvent &ev)
+{
+    const std::vector<std::byte> &content = event_content(ev);
+    const uint8_t type = ev.type;
+    const uint32_t wire_id = static_cast<uint32_t>(ev.msg_id);
+    const uint16_t len = static_cast<uint16_t>(content.size());
 
+    size_t pos = packet.size();
+    packet.resize(pos + FRAME_HEADER_LEN + len);
+    packet[pos] = std::byte{type};
+    memcpy(&packet[pos + 1], &wire_id, sizeof(wire_id));
+    memcpy(&packet[pos + 1 + sizeof(wire_id)], &len, sizeof(len));
+    if (len > 0)
+        memcpy(&packet[pos + FRAME_HEADER_LEN], &content[0], len);
+}
+
+void seal_packet(std::vector<std::byte> &packet)
+{
     /* Calculate CRC from the previous content of the packet.*/
+    size_t data_len = packet.size();
     uint32_t crc = CRC::Calculate(&packet[0], data_len, CRC::CRC_32());
+    packet.resize(data_len + CRC_LEN);
     memcpy(&packet[data_len], &crc, sizeof(crc));
 }
 
-bool packet2msg(std::vector<std::byte> &packet, uint32_t &id,
-                MainEventType &type, std::vector<std::byte> &data)
+bool packet2frames(const std::vector<std::byte> &packet,
+                   const std::string &origin_ip, uint32_t &session,
+                   std::vector<MainEvent> &frames)
 {
-    type = (MainEventType)packet[0];
-    memcpy(&id, &packet[1], sizeof(id));
+    if (packet.size() < SESSION_ID_LEN + FRAME_HEADER_LEN + CRC_LEN)
+        return false;
 
-    /* Packet length is 1 + sizeof(id) + data_length + 4 (CRC) */
+    const size_t data_len = packet.size() - CRC_LEN;
+    memcpy(&session, &packet[0], sizeof(session));
+    size_t pos = SESSION_ID_LEN;
+    while (pos + FRAME_HEADER_LEN <= data_len) {
+        MainEvent ev{.content{},
+                     .msg_id{0},
+                     .origin_ip{origin_ip},
+                     .type{},
+                     .session{session}};
+        uint32_t wire_id = 0;
+        uint16_t len = 0;
+        uint8_t wire_type = std::to_integer<uint8_t>(packet[pos]);
+        ev.type = static_cast<MainEventType>(wire_type);
+        memcpy(&wire_id, &packet[pos + 1], sizeof(wire_id));
+        memcpy(&len, &packet[pos + 1 + sizeof(wire_id)], sizeof(len));
+        ev.msg_id = wire_id;
+        pos += FRAME_HEADER_LEN;
 
-    size_t data_len = packet.size() - sizeof(id) - CRC_LEN - 1;
-    data.resize(data_len);
-    memcpy(&data[0], &packet[1 + sizeof(id)], data_len);
+        /* Frame runs past the packet, the rest is garbage. */
+        if (pos + len > data_len)
+            break;
+
+        /* Not a type peers send, M_TIO and up are local only. */
+        if (wire_type > OutEventType::O_CHUNK) {
+            pos += len;
+            continue;
+        }
+
+        ev.content.assign(packet.begin() + pos, packet.begin() + pos + len);
+        pos += len;
+        frames.push_back(ev);
+    }
 
     uint32_t target_crc = 0;
-    memcpy(&target_crc, &packet[1 + sizeof(id) + data_len], sizeof(target_crc));
+    memcpy(&target_crc, &packet[data_len], sizeof(target_crc));
 
-    uint32_t crc =
-        CRC::Calculate(&packet[0], 1 + sizeof(id) + data_len, CRC::CRC_32());
+    uint32_t crc = CRC::Calculate(&packet[0], data_len, CRC::CRC_32());
     return crc == target_crc;
 }
 
+void bundle_frames(const std::vector<OutEvent> &evs,
+                   std::vector<OutPacket> &packets)
+{
+    typedef struct {
+        OutPacket packet;
+        size_t last_frame; /* Offset of the last frame in the packet. */
+        uint32_t session;
+        std::vector<std::pair<uint8_t, uint64_t>> frames;
+    } OpenPacket;
+
+    std::vector<OpenPacket> open;
+
+    for (const OutEvent &ev : evs) {
+        const uint8_t type = ev.type;
+        const size_t len = FRAME_HEADER_LEN + event_content(ev).size();
+        bool is_ack = ev.type == OutEventType::O_ACK &&
+                      ev.content.size() == ACK_LEN;
+        bool placed = false;
+
+        for (OpenPacket &p : open) {
+            auto &bytes = p.packet.bytes;
+            if (p.packet.dest_ip != ev.dest_ip || p.session != ev.session)
+                continue;
+
+            /* Same frame again: keep the copies apart. */
+            auto key = std::make_pair(type, ev.msg_id);
+            if (std::find(p.frames.begin(), p.frames.end(), key) !=
+                p.frames.end())
+                continue;
+
+            /* Next ID after the ACK (range) at the end: extend the range and
+             * carry the newer receive limit. The timestamp stays the oldest,
+             * so no message in the range looks to have arrived later than
+             * it did. */
+            if (is_ack && (uint8_t)bytes[p.last_frame] == type &&
+                bytes[p.last_frame + FRAME_HEADER_LEN] == ev.content[0]) {
+                uint32_t first = 0;
+                uint16_t clen = 0;
+                uint16_t count = 1;
+                memcpy(&first, &bytes[p.last_frame + 1], sizeof(first));
+                memcpy(&clen, &bytes[p.last_frame + 1 + sizeof(first)],
+                       sizeof(clen));
+                size_t count_at = p.last_frame + FRAME_HEADER_LEN + ACK_LEN;
+                if (clen == ACK_RANGE_LEN)
+                    memcpy(&count, &bytes[count_at], sizeof(count));
+
+                bool fits = clen == ACK_RANGE_LEN ||
+                            bytes.size() + ACK_RANGE_LEN - ACK_LEN <=
+                                PACKET_LEN - CRC_LEN;
+                if (fits && count < UINT16_MAX &&
+                    first + count == static_cast<uint32_t>(ev.msg_id)) {
+                    if (clen == ACK_LEN) {
+                        clen = ACK_RANGE_LEN;
+                        memcpy(&bytes[p.last_frame + 1 + sizeof(first)], &clen,
+                               sizeof(clen));
+                        bytes.resize(bytes.size() + ACK_RANGE_LEN - ACK_LEN);
+                    }
+                    ++count;
+                    memcpy(&bytes[count_at], &count, sizeof(count));
+                    memcpy(&bytes[p.last_frame + FRAME_HEADER_LEN + 1],
+                           &ev.content[1], sizeof(uint32_t));
+                    p.frames.push_back(key);
+                    placed = true;
+                    break;
+                }
+            }
+
+            if (bytes.size() + len > PACKET_LEN - CRC_LEN)
+                continue;
+
+            p.last_frame = bytes.size();
+            append_frame(bytes, ev);
+            p.frames.push_back(key);
+            placed = true;
+            break;
+        }
+
+        if (!placed) {
+            OpenPacket p{.packet = OutPacket{.bytes{}, .dest_ip = ev.dest_ip},
+                         .last_frame = SESSION_ID_LEN,
+                         .session = ev.session,
+                         .frames{{type, ev.msg_id}}};
+            p.packet.bytes.resize(SESSION_ID_LEN);
+            memcpy(&p.packet.bytes[0], &ev.session, sizeof(ev.session));
+            append_frame(p.packet.bytes, ev);
+            open.push_back(p);
+        }
+    }
+
+    for (OpenPacket &p : open) {
+        seal_packet(p.packet.bytes);
+        packets.push_back(std::move(p.packet));
+    }
+}
+
+std::vector<std::byte> make_ack(uint8_t status, uint64_t recv_limit)
+{
+    uint32_t limit = static_cast<uint32_t>(recv_limit);
+    std::vector<std::byte> content(ACK_LEN);
+    content[0] = std::byte{status};
+    memcpy(&content[1], &limit, sizeof(limit));
+    uint32_t stamp = wire_stamp(std::chrono::high_resolution_clock::now());
+    memcpy(&content[1 + sizeof(limit)], &stamp, sizeof(stamp));
+
+    return content;
+}
+
+uint32_t wire_stamp(time_p t)
+{
+    using namespace std::chrono;
+    return static_cast<uint32_t>(
+        duration_cast<microseconds>(t.time_since_epoch()).count());
+}
+
+uint64_t expand_id(uint32_t wire_id, uint64_t expected)
+{
+    const uint64_t span = 1ull << 32;
+    uint64_t id = (expected & ~(span - 1)) | wire_id;
+
+    /* Of the candidates one span apart, take the one closest to expected. */
+    if (id + span / 2 < expected && id <= UINT64_MAX - span)
+        id += span;
+    else if (id > expected + span / 2 && id >= span)
+        id -= span;
+
+    return id;
+}
+
+bool is_multicast_ip(const std::string &ip)
+{
+    struct in_addr addr;
+    if (inet_pton(AF_INET, ip.c_str(), &addr) != 1)
+        return false;
+
+    return IN_MULTICAST(ntohl(addr.s_addr));
+}
+
 size_t get_file_size(const std::string &f_name)
 {
     std::ifstream file(f_name, std::ios::binary | std::ios::ate);
@@ -51,6 +233,15 @@ std::string extract_file_name(const std::string &file_path)
     return std::filesystem::path(file_path).filename().string();
 }
 
+std::string local_file_name(const std::string &peer_name)
+{
+    std::string name = extract_file_name(peer_name);
+    if (name.empty() || name[0] == '.')
+        return "";
+
+    return name;
+}
+
 std::string get_sha(const std::string &f_path)
 {
     std::ifstream file{f_path, std::ios::binary};
@@ -0,0 +1,187 @@
+#include "chunk_cache.h"
+#include "received_set.h"
+#include "send_window.h"
+#include "timer_wheel.h"
+#include "utils.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * Checks that message IDs, packet counts and file offsets hold up past
+ * 2^32: the 32-bit wire IDs expand back to the full ones, the per message
+ * structures work across the wrap, and chunks of a file with more than 2^32
+ * of them are read from the right offsets.
+ */
+
+volatile bool stop = false;
+volatile bool sending = true;
+
+static const uint64_t SPAN = 1ull << 32;
+static int failures = 0;
+
+#define CHECK(cond)                                                            \
+    do {                                                                       \
+        if (!(cond)) {                                                         \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " #cond " failed."   \
+                      << std::endl;                                            \
+            ++failures;                                                        \
+        }                                                                      \
+    } while (0)
+
+void test_expand_id()
+{
+    /* Around 0, the 32-bit wrap, a few spans up and far out. */
+    const std::vector<uint64_t> expected{0,        5,        SPAN - 3,
+                                         SPAN,     SPAN + 2, 3 * SPAN - 1,
+                                         1ull << 40};
+    const std::vector<int64_t> far{-(int64_t)(SPAN / 2) + 1,
+                                   (int64_t)(SPAN / 2) - 1};
+
+    for (uint64_t exp : expected) {
+        for (int64_t d = -1000; d <= 1000; ++d) {
+            if ((int64_t)exp + d < 0)
+                continue;
+            uint64_t id = exp + d;
+            CHECK(expand_id(static_cast<uint32_t>(id), exp) == id);
+        }
+        for (int64_t d : far) {
+            if ((int64_t)exp + d < 0)
+                continue;
+            uint64_t id = exp + d;
+            CHECK(expand_id(static_cast<uint32_t>(id), exp) == id);
+        }
+    }
+}
+
+void test_received_set()
+{
+    /* A million IDs, pairwise swapped, across the wrap. */
+    const uint64_t base = SPAN - 500000;
+    ReceivedSet set{base};
+    for (uint64_t i = 0; i < 1000000; i += 2) {
+        CHECK(set.insert(base + i + 1));
+        CHECK(set.insert(base + i));
+    }
+
+    CHECK(set.size() == 1000000);
+    CHECK(set.contains(base) && set.contains(SPAN));
+    CHECK(!set.contains(base - 1) && !set.contains(base + 1000000));
+    CHECK(!set.insert(SPAN + 7));
+}
+
+void test_send_window_timers()
+{
+    SendWindow window;
+    TimerWheel timers;
+    std::vector<std::byte> content(10);
+    auto now = std::chrono::high_resolution_clock::now();
+
+    for (uint64_t id = SPAN - 1000; id < SPAN + 1000; ++id) {
+        window.push(id, content);
+        timers.arm(id, now);
+    }
+    for (uint64_t id = SPAN - 1000; id < SPAN + 1000; id += 2) {
+        window.ack(id);
+        timers.cancel(id);
+    }
+
+    SentMessage *msg = window.find(SPAN + 1);
+    CHECK(msg != nullptr && !msg->ackd && msg->id == SPAN + 1);
+    CHECK(window.acked() == 1000);
+
+    std::vector<uint64_t> expired;
+    timers.expire(now + std::chrono::seconds(1), expired);
+    CHECK(expired.size() == 1000);
+    for (uint64_t id : expired)
+        CHECK(id % 2 == 1 && id >= SPAN - 1000 && id < SPAN + 1000);
+}
+
+void test_ack_range_wrap()
+{
+    /* ACKs of 6 IDs across the wrap go out as ranges and come back whole,
+     * each range with the stamp of its first ACK. */
+    std::vector<OutEvent> evs;
+    for (uint64_t id = SPAN - 3; id < SPAN + 3; ++id) {
+        std::vector<std::byte> ack = make_ack(ACK_OK, SPAN + 100);
+        uint32_t stamp = static_cast<uint32_t>(id);
+        memcpy(&ack[1 + sizeof(uint32_t)], &stamp, sizeof(stamp));
+        evs.push_back(OutEvent{ack, id, "x", OutEventType::O_ACK, 1});
+    }
+
+    std::vector<OutPacket> packets;
+    bundle_frames(evs, packets);
+    CHECK(packets.size() == 1);
+
+    std::vector<MainEvent> frames;
+    uint32_t session = 0;
+    CHECK(packet2frames(packets[0].bytes, "x", session, frames));
+    CHECK(session == 1);
+
+    uint64_t next = SPAN - 3;
+    for (const MainEvent &f : frames) {
+        uint16_t count = 1;
+        if (f.content.size() == ACK_RANGE_LEN)
+            memcpy(&count, &f.content[ACK_LEN], sizeof(count));
+
+        uint32_t wire_limit = 0;
+        uint32_t stamp = 0;
+        memcpy(&wire_limit, &f.content[1], sizeof(wire_limit));
+        memcpy(&stamp, &f.content[1 + sizeof(wire_limit)], sizeof(stamp));
+        CHECK(expand_id(static_cast<uint32_t>(f.msg_id), SPAN) == next);
+        CHECK(expand_id(wire_limit, SPAN) == SPAN + 100);
+        CHECK(stamp == static_cast<uint32_t>(next));
+        next += count;
+    }
+    CHECK(next == SPAN + 3);
+}
+
+void test_chunk_offsets()
+{
+    /* A sparse file of 2^32 + 2 two-byte chunks, the last one short, with
+     * marks in the chunks past 2^32. */
+    const std::string name = "build/scaling_test.bin";
+    const size_t chunk_len = 2;
+    const uint64_t f_size = (SPAN + 1) * chunk_len + 1;
+
+    int fd = open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    CHECK(fd >= 0);
+    if (fd < 0)
+        return;
+    const char marks[] = {'a', 'b', 'c'};
+    bool written = ftruncate(fd, f_size) == 0 &&
+                   pwrite(fd, marks, sizeof(marks), SPAN * chunk_len) ==
+                       static_cast<ssize_t>(sizeof(marks));
+    close(fd);
+    CHECK(written);
+
+    if (written) {
+        ChunkCache cache{name, chunk_len, 1};
+        CHECK(cache.chunk_count() == SPAN + 2);
+
+        Chunk first = cache.take(0, 0);
+        Chunk past = cache.take(0, SPAN);
+        Chunk last = cache.take(0, SPAN + 1);
+        CHECK(first->size() == 2 && (*first)[0] == std::byte{0});
+        CHECK(past->size() == 2 && (*past)[0] == std::byte{'a'} &&
+              (*past)[1] == std::byte{'b'});
+        CHECK(last->size() == 1 && (*last)[0] == std::byte{'c'});
+    }
+
+    std::remove(name.c_str());
+}
+
+int main()
+{
+    test_expand_id();
+    test_received_set();
+    test_send_window_timers();
+    test_ack_range_wrap();
+    test_chunk_offsets();
+
+    if (failures > 0) {
+        std::cout << failures << " checks failed." << std::endl;
+        return 1;
+    }
+    std::cout << "Scaling test passed." << std::endl;
+    return 0;
+}
@@ -0,0 +1,192 @@
+#include "out_queue.h"
+#include "token_bucket.h"
+#include "utils.h"
+
+/**
+ * Checks the send scheduler: deficit round robin serves sessions in
+ * proportion to their weights, and the token buckets hold sessions under
+ * their own rate caps and everything under the global one, without holding
+ * up the sessions that aren't capped.
+ */
+
+volatile bool stop = false;
+volatile bool sending = true;
+
+static int failures = 0;
+
+#define CHECK(cond)                                                            \
+    do {                                                                       \
+        if (!(cond)) {                                                         \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " #cond " failed."   \
+                      << std::endl;                                            \
+            ++failures;                                                        \
+        }                                                                      \
+    } while (0)
+
+/* Data events of a session, each content_len long on top of the frame. */
+static void push_data(OutQueue &queue, uint32_t session, uint64_t n,
+                      size_t content_len)
+{
+    for (uint64_t id = 0; id < n; ++id)
+        queue.push(OutEvent{std::vector<std::byte>(content_len), id, "x",
+                            OutEventType::O_MSG, session});
+}
+
+/* Takes n events, in as many calls as the caps make it. [s] */
+static double drain(OutQueue &queue, size_t n, std::vector<OutEvent> &taken)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    while (taken.size() < n) {
+        std::vector<OutEvent> evs = queue.wait_nonempty(n - taken.size());
+        taken.insert(taken.end(), evs.begin(), evs.end());
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+void test_drr_weights()
+{
+    /* Quantum sized events: weights 1 and 3 send 1 and 3 of them a turn. */
+    OutQueue queue;
+    queue.set_share(1, 1, 0.0);
+    queue.set_share(2, 3, 0.0);
+    push_data(queue, 1, 400, DRR_QUANTUM - FRAME_HEADER_LEN);
+    push_data(queue, 2, 400, DRR_QUANTUM - FRAME_HEADER_LEN);
+
+    std::vector<OutEvent> taken = queue.wait_nonempty(200);
+    CHECK(taken.size() == 200);
+
+    uint64_t next[3] = {0, 0, 0};
+    for (const OutEvent &ev : taken) {
+        CHECK(ev.session == 1 || ev.session == 2);
+        CHECK(ev.msg_id == next[ev.session]);
+        ++next[ev.session];
+    }
+    CHECK(next[1] == 50 && next[2] == 150);
+
+    /* Small events go by bytes too: their counts split about 1 to 3. */
+    OutQueue small;
+    small.set_share(1, 1, 0.0);
+    small.set_share(2, 3, 0.0);
+    push_data(small, 1, 4000, 100);
+    push_data(small, 2, 4000, 100);
+
+    size_t counts[3] = {0, 0, 0};
+    for (const OutEvent &ev : small.wait_nonempty(2000))
+        ++counts[ev.session];
+    CHECK(counts[1] + counts[2] == 2000);
+    CHECK(counts[1] >= 480 && counts[1] <= 520);
+
+    /* A session's resends go before its own data. */
+    OutQueue lanes;
+    push_data(lanes, 1, 2, 100);
+    lanes.push(OutEvent{std::vector<std::byte>(100), 7, "x",
+                        OutEventType::O_MSG, 1},
+               OutLane::L_RESEND);
+    std::vector<OutEvent> order = lanes.wait_nonempty(3);
+    CHECK(order.size() == 3 && order[0].msg_id == 7);
+}
+
+void test_token_bucket()
+{
+    using namespace std::chrono;
+    TokenBucket bucket{1e6};
+    const time_p start = high_resolution_clock::now();
+    const double depth = 1e6 * RATE_BURST / 1e6;
+
+    /* Idle for long: a burst of depth, then the debt holds it back. */
+    time_p t = start + seconds(1);
+    CHECK(bucket.has_room(t));
+    bucket.take(static_cast<size_t>(depth) + 1000);
+    CHECK(!bucket.has_room(t));
+    CHECK(bucket.ready_at() == t + microseconds(1001));
+    CHECK(bucket.has_room(bucket.ready_at()));
+
+    /* A packet whenever there is room, for a second: the rate, plus no
+     * more than the burst and a packet. */
+    TokenBucket paced{1e6};
+    t = high_resolution_clock::now();
+    size_t sent = 0;
+    for (int step = 1; step <= 10000; ++step) {
+        time_p now = t + microseconds(100 * step);
+        while (paced.has_room(now)) {
+            paced.take(PACKET_LEN);
+            sent += PACKET_LEN;
+        }
+    }
+    CHECK(sent >= 1e6 - PACKET_LEN && sent <= 1e6 + depth + PACKET_LEN);
+
+    /* No rate, no cap. */
+    TokenBucket open{0.0};
+    open.take(1 << 30);
+    CHECK(!open.limited() && open.has_room(t));
+}
+
+void test_session_cap()
+{
+    /* 100 kB for a session capped at 1 MB/s, next to an uncapped one. */
+    OutQueue queue;
+    queue.set_share(1, 1, 1e6);
+    push_data(queue, 1, 100, PACKET_LEN - FRAME_HEADER_LEN);
+    push_data(queue, 2, 100, PACKET_LEN - FRAME_HEADER_LEN);
+    CHECK(queue.rate_cap(1) == 1e6 && queue.rate_cap(2) == 0.0);
+
+    std::vector<OutEvent> taken;
+    double secs = drain(queue, 200, taken);
+
+    /* The uncapped session doesn't wait for the capped one's tokens: it is
+     * through while the capped one is still in its burst. */
+    size_t last_uncapped = 0;
+    for (size_t i = 0; i < taken.size(); ++i)
+        if (taken[i].session == 2)
+            last_uncapped = i;
+    CHECK(last_uncapped < 150);
+
+    /* All but the burst at the cap: no faster, and not much slower. */
+    double floor = (100.0 * PACKET_LEN - 1e6 * RATE_BURST / 1e6 -
+                    PACKET_LEN) / 1e6;
+    CHECK(secs >= floor);
+    CHECK(secs < 2 * floor + 0.05);
+}
+
+void test_global_cap()
+{
+    /* 200 kB of two uncapped sessions under a global cap of 1 MB/s, and a
+     * session cap below it. */
+    OutQueue queue;
+    queue.set_rate(1e6);
+    queue.set_share(3, 1, 5e5);
+    CHECK(queue.rate_cap(1) == 1e6 && queue.rate_cap(3) == 5e5);
+
+    push_data(queue, 1, 100, PACKET_LEN - FRAME_HEADER_LEN);
+    push_data(queue, 2, 100, PACKET_LEN - FRAME_HEADER_LEN);
+
+    std::vector<OutEvent> taken;
+    double secs = drain(queue, 200, taken);
+
+    /* Both get their turns while the cap holds them back. */
+    size_t first[3] = {0, 0, 0};
+    for (size_t i = 0; i < 100; ++i)
+        ++first[taken[i].session];
+    CHECK(first[1] >= 45 && first[2] >= 45);
+
+    double floor = (200.0 * PACKET_LEN - 1e6 * RATE_BURST / 1e6 -
+                    PACKET_LEN) / 1e6;
+    CHECK(secs >= floor);
+    CHECK(secs < 2 * floor + 0.05);
+}
+
+int main()
+{
+    test_drr_weights();
+    test_token_bucket();
+    test_session_cap();
+    test_global_cap();
+
+    if (failures > 0) {
+        std::cout << failures << " checks failed." << std::endl;
+        return 1;
+    }
+    std::cout << "Scheduler test passed." << std::endl;
+    return 0;
+}